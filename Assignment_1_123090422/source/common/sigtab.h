@@ -0,0 +1,255 @@
+#ifndef SIGTAB_H
+#define SIGTAB_H
+
+/*
+ * Signal table shared by program1 (userspace) and program2 (kernel).
+ *
+ * One dense, constant table indexed by signal number holds the name, a
+ * short description ("child process <desc>"), the default action and
+ * whether that action dumps core, so decoding a signal is a single array
+ * lookup. Entries use the SIGxxx macros, which keeps them right on
+ * architectures that number signals differently. Real-time signals are
+ * named by their kernel number (SIGRT32 ... SIGRT64); glibc reserves the
+ * first two, so its SIGRTMIN is SIGRT34.
+ */
+
+#ifdef __KERNEL__
+#include <linux/signal.h>
+#else
+#include <signal.h>
+#endif
+
+enum sigtab_action {
+	SIGTAB_NONE,		/* not a signal */
+	SIGTAB_TERM,
+	SIGTAB_CORE,		/* terminate and dump core */
+	SIGTAB_IGN,
+	SIGTAB_STOP,
+	SIGTAB_CONT,
+};
+
+struct sigtab_entry {
+	const char *name;
+	const char *desc;
+	unsigned char action;	/* enum sigtab_action */
+	unsigned char core;
+};
+
+#define SIGTAB_NSIG 65		/* signals 1 ... 64 */
+
+#define SIGTAB_SIG(sig, d, act) \
+	[sig] = { #sig, d, SIGTAB_##act, SIGTAB_##act == SIGTAB_CORE }
+#define SIGTAB_RT(n) \
+	[n] = { "SIGRT" #n, "gets a real-time signal", SIGTAB_TERM, 0 }
+
+static const struct sigtab_entry sigtab[SIGTAB_NSIG] = {
+	SIGTAB_SIG(SIGHUP, "hangs up controlling terminal or process", TERM),
+	SIGTAB_SIG(SIGINT, "has interrupt from keyboard", TERM),
+	SIGTAB_SIG(SIGQUIT, "quits from keyboard", CORE),
+	SIGTAB_SIG(SIGILL, "has illegal instruction", CORE),
+	SIGTAB_SIG(SIGTRAP, "has breakpoint for debugging", CORE),
+	SIGTAB_SIG(SIGABRT, "is aborted", CORE),
+	SIGTAB_SIG(SIGBUS, "has bus error", CORE),
+	SIGTAB_SIG(SIGFPE, "has floating-point exception", CORE),
+	SIGTAB_SIG(SIGKILL, "has forced-process termination", TERM),
+	SIGTAB_SIG(SIGUSR1, "gets user-defined signal 1", TERM),
+	SIGTAB_SIG(SIGSEGV, "has illegal memory reference", CORE),
+	SIGTAB_SIG(SIGUSR2, "gets user-defined signal 2", TERM),
+	SIGTAB_SIG(SIGPIPE, "writes to pipe with no readers", TERM),
+	SIGTAB_SIG(SIGALRM, "is alarmed", TERM),
+	SIGTAB_SIG(SIGTERM, "has process termination", TERM),
+#ifdef SIGSTKFLT
+	SIGTAB_SIG(SIGSTKFLT, "has coprocessor stack fault", TERM),
+#endif
+	SIGTAB_SIG(SIGCHLD, "has a child that stopped or terminated", IGN),
+	SIGTAB_SIG(SIGCONT, "is continued", CONT),
+	SIGTAB_SIG(SIGSTOP, "has stopped process execution", STOP),
+	SIGTAB_SIG(SIGTSTP, "is stopped from the terminal", STOP),
+	SIGTAB_SIG(SIGTTIN, "reads from the terminal in the background", STOP),
+	SIGTAB_SIG(SIGTTOU, "writes to the terminal in the background", STOP),
+	SIGTAB_SIG(SIGURG, "has urgent data on a socket", IGN),
+	SIGTAB_SIG(SIGXCPU, "exceeds its CPU time limit", CORE),
+	SIGTAB_SIG(SIGXFSZ, "exceeds its file size limit", CORE),
+	SIGTAB_SIG(SIGVTALRM, "has its virtual timer expire", TERM),
+	SIGTAB_SIG(SIGPROF, "has its profiling timer expire", TERM),
+	SIGTAB_SIG(SIGWINCH, "has its window resized", IGN),
+	SIGTAB_SIG(SIGIO, "has I/O possible", TERM),
+#ifdef SIGPWR
+	SIGTAB_SIG(SIGPWR, "has a power failure", TERM),
+#endif
+	SIGTAB_SIG(SIGSYS, "makes a bad system call", CORE),
+	SIGTAB_RT(32), SIGTAB_RT(33), SIGTAB_RT(34), SIGTAB_RT(35),
+	SIGTAB_RT(36), SIGTAB_RT(37), SIGTAB_RT(38), SIGTAB_RT(39),
+	SIGTAB_RT(40), SIGTAB_RT(41), SIGTAB_RT(42), SIGTAB_RT(43),
+	SIGTAB_RT(44), SIGTAB_RT(45), SIGTAB_RT(46), SIGTAB_RT(47),
+	SIGTAB_RT(48), SIGTAB_RT(49), SIGTAB_RT(50), SIGTAB_RT(51),
+	SIGTAB_RT(52), SIGTAB_RT(53), SIGTAB_RT(54), SIGTAB_RT(55),
+	SIGTAB_RT(56), SIGTAB_RT(57), SIGTAB_RT(58), SIGTAB_RT(59),
+	SIGTAB_RT(60), SIGTAB_RT(61), SIGTAB_RT(62), SIGTAB_RT(63),
+	SIGTAB_RT(64),
+};
+
+#undef SIGTAB_SIG
+#undef SIGTAB_RT
+
+/* NULL for numbers that are not signals */
+static inline const struct sigtab_entry *sigtab_get(int sig)
+{
+	if (sig <= 0 || sig >= SIGTAB_NSIG || !sigtab[sig].name)
+		return 0;
+	return &sigtab[sig];
+}
+
+static inline const char *sigtab_name(int sig)
+{
+	const struct sigtab_entry *e = sigtab_get(sig);
+
+	return e ? e->name : "SIG?";
+}
+
+/* si_code values that mean the same for every signal */
+static inline const char *sigtab_si_name(int code)
+{
+	switch (code) {
+	case SI_USER:
+		return "SI_USER";
+	case SI_KERNEL:
+		return "SI_KERNEL";
+	case SI_QUEUE:
+		return "SI_QUEUE";
+	case SI_TIMER:
+		return "SI_TIMER";
+	case SI_MESGQ:
+		return "SI_MESGQ";
+	case SI_ASYNCIO:
+		return "SI_ASYNCIO";
+	case SI_SIGIO:
+		return "SI_SIGIO";
+	case SI_TKILL:
+		return "SI_TKILL";
+	}
+	return 0;
+}
+
+#define SIGTAB_CODE(c)	[c] = #c
+
+static const char *const sigtab_ill_codes[] = {
+	SIGTAB_CODE(ILL_ILLOPC), SIGTAB_CODE(ILL_ILLOPN),
+	SIGTAB_CODE(ILL_ILLADR), SIGTAB_CODE(ILL_ILLTRP),
+	SIGTAB_CODE(ILL_PRVOPC), SIGTAB_CODE(ILL_PRVREG),
+	SIGTAB_CODE(ILL_COPROC), SIGTAB_CODE(ILL_BADSTK),
+};
+
+static const char *const sigtab_fpe_codes[] = {
+	SIGTAB_CODE(FPE_INTDIV), SIGTAB_CODE(FPE_INTOVF),
+	SIGTAB_CODE(FPE_FLTDIV), SIGTAB_CODE(FPE_FLTOVF),
+	SIGTAB_CODE(FPE_FLTUND), SIGTAB_CODE(FPE_FLTRES),
+	SIGTAB_CODE(FPE_FLTINV), SIGTAB_CODE(FPE_FLTSUB),
+};
+
+static const char *const sigtab_segv_codes[] = {
+	SIGTAB_CODE(SEGV_MAPERR), SIGTAB_CODE(SEGV_ACCERR),
+#ifdef SEGV_BNDERR
+	SIGTAB_CODE(SEGV_BNDERR),
+#endif
+#ifdef SEGV_PKUERR
+	SIGTAB_CODE(SEGV_PKUERR),
+#endif
+};
+
+static const char *const sigtab_bus_codes[] = {
+	SIGTAB_CODE(BUS_ADRALN), SIGTAB_CODE(BUS_ADRERR),
+	SIGTAB_CODE(BUS_OBJERR),
+#ifdef BUS_MCEERR_AR
+	SIGTAB_CODE(BUS_MCEERR_AR), SIGTAB_CODE(BUS_MCEERR_AO),
+#endif
+};
+
+/* glibc only has these with X/Open extensions enabled */
+static const char *const sigtab_trap_codes[] = {
+	[0] = 0,
+#ifdef TRAP_BRKPT
+	SIGTAB_CODE(TRAP_BRKPT), SIGTAB_CODE(TRAP_TRACE),
+#endif
+#ifdef TRAP_BRANCH
+	SIGTAB_CODE(TRAP_BRANCH), SIGTAB_CODE(TRAP_HWBKPT),
+#endif
+};
+
+#undef SIGTAB_CODE
+
+#define SIGTAB_LOOKUP(tab, code) \
+	((code) < (int)(sizeof(tab) / sizeof(tab[0])) ? tab[code] : 0)
+
+/*
+ * Name of the si_code a signal was delivered with, e.g. SEGV_MAPERR for a
+ * fault or SI_TKILL for raise(); "" when it is not one we know. Positive
+ * codes are specific to the hardware fault signals.
+ */
+static inline const char *sigtab_code_name(int sig, int code)
+{
+	const char *name = 0;
+
+	if (code <= 0 || code == SI_KERNEL)
+		name = sigtab_si_name(code);
+	else if (sig == SIGILL)
+		name = SIGTAB_LOOKUP(sigtab_ill_codes, code);
+	else if (sig == SIGFPE)
+		name = SIGTAB_LOOKUP(sigtab_fpe_codes, code);
+	else if (sig == SIGSEGV)
+		name = SIGTAB_LOOKUP(sigtab_segv_codes, code);
+	else if (sig == SIGBUS)
+		name = SIGTAB_LOOKUP(sigtab_bus_codes, code);
+	else if (sig == SIGTRAP)
+		name = SIGTAB_LOOKUP(sigtab_trap_codes, code);
+	return name ? name : "";
+}
+
+#undef SIGTAB_LOOKUP
+
+/* the fault signals, whose si_addr is the faulting address when the kernel
+ * raised them (si_code > 0) */
+static inline int sigtab_has_addr(int sig, int code)
+{
+	return code > 0 && code != SI_KERNEL &&
+	       (sig == SIGILL || sig == SIGFPE || sig == SIGSEGV ||
+		sig == SIGBUS || sig == SIGTRAP);
+}
+
+enum sigtab_kind {
+	SIGTAB_EXITED,
+	SIGTAB_SIGNALED,
+	SIGTAB_STOPPED,
+	SIGTAB_CONTINUED,
+};
+
+/* a wait status taken apart, with the same bit layout in both worlds */
+struct sigtab_status {
+	int kind;		/* enum sigtab_kind */
+	int code;		/* exit code if exited */
+	int signo;		/* terminating or stopping signal */
+	int core;		/* a core dump was written */
+};
+
+static inline void sigtab_decode(int status, struct sigtab_status *st)
+{
+	st->code = 0;
+	st->signo = 0;
+	st->core = 0;
+	if ((status & 0x7f) == 0) {
+		st->kind = SIGTAB_EXITED;
+		st->code = (status >> 8) & 0xff;
+	} else if (status == 0xffff) {
+		st->kind = SIGTAB_CONTINUED;
+		st->signo = SIGCONT;
+	} else if ((status & 0xff) == 0x7f) {
+		st->kind = SIGTAB_STOPPED;
+		st->signo = (status >> 8) & 0xff;
+	} else {
+		st->kind = SIGTAB_SIGNALED;
+		st->signo = status & 0x7f;
+		st->core = (status & 0x80) != 0;
+	}
+}
+
+#endif
@@ -1,13 +1,23 @@
 #include <stdio.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/time.h>
 
 int main(int argc,char* argv[]){
+#ifdef FAST
+	static const char msg[] = "This is the SIGALRM program\n";
+	struct itimerval soon = { .it_value = { 0, 1000 } };
+
+	write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+	setitimer(ITIMER_REAL, &soon, NULL);
+	pause();
+#else
 	printf("------------CHILD PROCESS START------------\n");
 	printf("This is the SIGALRM program\n\n");
 	alarm(2);
 	sleep(5);
 	printf("------------CHILD PROCESS END------------\n");
+#endif
 
 	return 0;
 }
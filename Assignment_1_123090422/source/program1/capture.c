@@ -0,0 +1,400 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+
+#define CAPTURE_PIPE_SIZE (1 << 20)
+
+static const char *const stream_names[2] = { "stdout", "stderr" };
+
+/* one log per child, shared by its two streams, or one for all children
+ * when multiplexing; a frame, once started, owns the log until its last
+ * byte is out */
+struct capture_log {
+    struct capture *cap;
+    int fd;
+    int refs;
+    int owned;          /* close fd with the last reference */
+    int use_splice;
+    struct capture_stream *cur;     /* writer of the frame in progress */
+    struct capture_stream *waiting; /* streams paused behind it */
+    struct reaper_watch *outw;      /* EPOLLOUT while the log is full */
+    char hdr[160];
+    size_t hdr_len, hdr_off;
+    size_t left;        /* frame bytes still sitting in cur's pipe */
+    size_t buf_len, buf_off;
+    char buf[16384];    /* copy fallback when splice() is refused */
+};
+
+struct capture_stream {
+    struct capture *cap;
+    struct capture_log *log;
+    struct reaper_watch *w;         /* NULL while paused */
+    struct capture_stream *next;
+    int fd;
+    int which;
+    pid_t pid;
+    char name[64];
+};
+
+void capture_init(struct capture *cap, const char *dir, int fd)
+{
+    cap->dir = dir;
+    cap->fd = fd;
+    cap->open_streams = 0;
+    cap->shared = NULL;
+}
+
+int capture_prepare(struct capture_child *cc)
+{
+    int p[2][2], i;
+
+    for (i = 0; i < 2; i++) {
+        if (pipe2(p[i], O_CLOEXEC) < 0) {
+            if (i) {
+                close(p[0][0]);
+                close(p[0][1]);
+            }
+            return -1;
+        }
+        /* a large pipe lets bursts land without blocking the child;
+         * failing to grow it is harmless */
+        fcntl(p[i][1], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+        fcntl(p[i][0], F_SETFL, O_NONBLOCK);
+    }
+    cc->stdio[0] = -1;
+    cc->stdio[1] = p[0][1];
+    cc->stdio[2] = p[1][1];
+    cc->rd[0] = p[0][0];
+    cc->rd[1] = p[1][0];
+    return 0;
+}
+
+static void log_put(struct capture_log *log)
+{
+    if (--log->refs > 0)
+        return;
+    if (log->cap->shared == log)
+        log->cap->shared = NULL;
+    if (log->owned)
+        close(log->fd);
+    free(log);
+}
+
+/* one step of the current frame: 1 on progress, 0 once it is out */
+static int log_step(struct capture_log *log)
+{
+    struct capture_stream *cs = log->cur;
+    ssize_t n;
+
+    if (log->hdr_off < log->hdr_len) {
+        n = write(log->fd, log->hdr + log->hdr_off,
+                  log->hdr_len - log->hdr_off);
+        if (n < 0)
+            return -1;
+        log->hdr_off += n;
+        return 1;
+    }
+    if (log->buf_off < log->buf_len) {
+        n = write(log->fd, log->buf + log->buf_off,
+                  log->buf_len - log->buf_off);
+        if (n < 0)
+            return -1;
+        log->buf_off += n;
+        return 1;
+    }
+    if (log->left == 0)
+        return 0;
+    if (log->use_splice) {
+        /* the frame's bytes are already in the pipe, so EAGAIN can only
+         * mean the log is full */
+        n = splice(cs->fd, NULL, log->fd, NULL, log->left,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            /* terminals or O_APPEND files */
+            log->use_splice = 0;
+            return 1;
+        }
+    } else {
+        n = read(cs->fd, log->buf,
+                 log->left < sizeof(log->buf) ? log->left : sizeof(log->buf));
+        if (n > 0) {
+            log->buf_off = 0;
+            log->buf_len = n;
+        }
+    }
+    if (n == 0)
+        errno = EIO;
+    if (n <= 0)
+        return -1;
+    log->left -= n;
+    return 1;
+}
+
+static int log_pump(struct capture_log *log)
+{
+    int rc;
+
+    while ((rc = log_step(log)) > 0 || (rc < 0 && errno == EINTR))
+        ;
+    return rc;
+}
+
+/* the log failed: throw the rest of the frame away so the pipe drains */
+static void log_drop(struct capture_log *log)
+{
+    while (log->left > 0) {
+        ssize_t n = read(log->cur->fd, log->buf,
+                         log->left < sizeof(log->buf) ?
+                         log->left : sizeof(log->buf));
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        log->left -= n;
+    }
+    log->left = 0;
+    log->buf_len = log->buf_off = 0;
+}
+
+static void stream_event(struct reaper *r, struct reaper_watch *w,
+                         uint32_t events);
+
+static void stream_close(struct reaper *r, struct capture_stream *cs)
+{
+    if (cs->w)
+        reaper_remove(r, cs->w);
+    close(cs->fd);
+    log_put(cs->log);
+    cs->cap->open_streams--;
+    free(cs);
+}
+
+/* stop polling a stream whose data cannot go out yet; it stays buffered
+ * in the pipe, which in turn throttles the child once that fills up */
+static void stream_pause(struct reaper *r, struct capture_stream *cs)
+{
+    reaper_remove(r, cs->w);
+    cs->w = NULL;
+    cs->next = cs->log->waiting;
+    cs->log->waiting = cs;
+}
+
+static void log_resume(struct reaper *r, struct capture_log *log)
+{
+    /* a failed stream may drop the last other reference */
+    log->refs++;
+    while (log->waiting) {
+        struct capture_stream *cs = log->waiting;
+
+        log->waiting = cs->next;
+        cs->w = reaper_add_fd(r, cs->fd, EPOLLIN, stream_event, cs);
+        if (!cs->w) {
+            perror("capture");
+            stream_close(r, cs);
+        }
+    }
+    log_put(log);
+}
+
+static void log_writable(struct reaper *r, struct reaper_watch *w,
+                         uint32_t events);
+
+/* write as much of the current frame as the log takes; when it is full,
+ * park the writer and wait for EPOLLOUT instead of blocking the loop */
+static void log_run(struct reaper *r, struct capture_log *log)
+{
+    if (log_pump(log) < 0) {
+        if (errno == EAGAIN) {
+            log->outw = reaper_add_fd(r, log->fd, EPOLLOUT, log_writable, log);
+            if (log->outw) {
+                if (log->cur->w)
+                    stream_pause(r, log->cur);
+                return;
+            }
+        }
+        perror("capture");
+        log_drop(log);
+    }
+    log->cur = NULL;
+    log_resume(r, log);
+}
+
+static void log_writable(struct reaper *r, struct reaper_watch *w,
+                         uint32_t events)
+{
+    struct capture_log *log = w->data;
+
+    (void)events;
+    reaper_remove(r, w);
+    log->outw = NULL;
+    log_run(r, log);
+}
+
+static void log_start(struct capture_log *log, struct capture_stream *cs,
+                      size_t len)
+{
+    struct timespec ts;
+    int n;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    n = snprintf(log->hdr, sizeof(log->hdr), "@@ %s %d %s %ld.%06ld %zu\n",
+                 cs->name, cs->pid, stream_names[cs->which], (long)ts.tv_sec,
+                 ts.tv_nsec / 1000, len);
+    log->hdr_len = n;
+    log->hdr_off = 0;
+    log->left = len;
+    log->cur = cs;
+    /* keep our own buffered report lines ahead of the chunk */
+    fflush(stdout);
+}
+
+static void stream_event(struct reaper *r, struct reaper_watch *w,
+                         uint32_t events)
+{
+    struct capture_stream *cs = w->data;
+    struct capture_log *log = cs->log;
+    int avail = 0;
+
+    /* FIONREAD tells how much to frame; level triggered epoll brings us
+     * back for whatever arrives after this chunk */
+    if (ioctl(cs->fd, FIONREAD, &avail) == 0 && avail > 0) {
+        /* another frame is still going out, possibly into a full log */
+        if (log->cur) {
+            stream_pause(r, cs);
+            return;
+        }
+        log_start(log, cs, avail);
+        log_run(r, log);
+        return;
+    }
+    if (events & (EPOLLHUP | EPOLLERR))
+        stream_close(r, cs);
+}
+
+void capture_sync(struct capture *cap, struct reaper *r)
+{
+    struct capture_log *log = cap->shared;
+    struct pollfd pfd;
+
+    if (!log || !log->cur)
+        return;
+    if (log->outw) {
+        reaper_remove(r, log->outw);
+        log->outw = NULL;
+    }
+    pfd.fd = log->fd;
+    pfd.events = POLLOUT;
+    while (log_pump(log) < 0) {
+        if (errno == EAGAIN && (poll(&pfd, 1, -1) >= 0 || errno == EINTR))
+            continue;
+        perror("capture");
+        log_drop(log);
+        break;
+    }
+    log->cur = NULL;
+    log_resume(r, log);
+}
+
+/* a private open file description of a pipe or terminal can go
+ * non-blocking without making our own stdout drop writes */
+static int log_reopen(int fd)
+{
+    struct stat st;
+    char path[64];
+
+    if (fstat(fd, &st) < 0 || !(S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode)))
+        return -1;
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    return open(path, O_WRONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+}
+
+static struct capture_log *log_open(struct capture *cap, const char *name,
+                                    pid_t pid)
+{
+    struct capture_log *log;
+    char path[4096];
+
+    if (!cap->dir && cap->shared)
+        return cap->shared;
+    log = calloc(1, sizeof(*log));
+    if (!log)
+        return NULL;
+    log->cap = cap;
+    log->use_splice = 1;
+    if (!cap->dir) {
+        /* regular files and sockets keep the plain fd; files never fill
+         * up, a socket just blocks like it did before */
+        log->fd = log_reopen(cap->fd);
+        log->owned = log->fd >= 0;
+        if (log->fd < 0)
+            log->fd = cap->fd;
+        cap->shared = log;
+        return log;
+    }
+    /* no O_APPEND: splice() refuses to write to append-only files */
+    snprintf(path, sizeof(path), "%s/%s.%d.log", cap->dir, name, pid);
+    log->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (log->fd < 0) {
+        perror(path);
+        free(log);
+        return NULL;
+    }
+    log->owned = 1;
+    return log;
+}
+
+int capture_attach(struct capture *cap, struct reaper *r,
+                   struct capture_child *cc, const char *name, pid_t pid)
+{
+    struct capture_log *log = NULL;
+    int i;
+
+    close(cc->stdio[1]);
+    close(cc->stdio[2]);
+    if (pid > 0)
+        log = log_open(cap, name, pid);
+    if (!log) {
+        close(cc->rd[0]);
+        close(cc->rd[1]);
+        return -1;
+    }
+
+    for (i = 0; i < 2; i++) {
+        struct capture_stream *cs = calloc(1, sizeof(*cs));
+
+        if (cs) {
+            cs->cap = cap;
+            cs->log = log;
+            cs->fd = cc->rd[i];
+            cs->which = i;
+            cs->pid = pid;
+            snprintf(cs->name, sizeof(cs->name), "%s", name);
+        }
+        if (cs)
+            cs->w = reaper_add_fd(r, cc->rd[i], EPOLLIN, stream_event, cs);
+        if (!cs || !cs->w) {
+            /* dropping the read end gives the child EPIPE, not a hang */
+            perror("capture");
+            close(cc->rd[i]);
+            free(cs);
+            continue;
+        }
+        log->refs++;
+        cap->open_streams++;
+    }
+    if (log->refs == 0)
+        log_put(log);
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <sys/types.h>
+
+#include "reaper.h"
+
+/*
+ * Per-child stdout/stderr capture.
+ *
+ * Each child writes into its own pipes. The supervisor drains them from the
+ * reaper loop and splices every chunk straight from the pipe into the log
+ * without copying it through user space, after a one line frame header:
+ *
+ *     @@ <program> <pid> <stdout|stderr> <sec.usec> <length>
+ *
+ * followed by exactly <length> bytes of output. Logs go either to one file
+ * per child (DIR/<program>.<pid>.log) or, multiplexed, to a shared fd.
+ * The pipes are enlarged and drained as soon as they become readable, so
+ * chatty children keep running while the supervisor waits for others.
+ * A multiplexed log is written non-blocking: when its reader falls behind
+ * the output stays in the children's pipes until the log has room again,
+ * and the reaper loop keeps serving everything else meanwhile.
+ */
+
+struct capture_log;
+
+struct capture {
+    const char *dir;    /* per child logs, NULL to multiplex into fd */
+    int fd;
+    int open_streams;   /* pipes not yet at EOF */
+    struct capture_log *shared;     /* the multiplexed log, while in use */
+};
+
+struct capture_child {
+    int stdio[3];       /* child ends, for spawn_opts.stdio */
+    int rd[2];          /* supervisor ends: stdout, stderr */
+};
+
+void capture_init(struct capture *cap, const char *dir, int fd);
+
+/* create the pipes for one child */
+int capture_prepare(struct capture_child *cc);
+/* after spawning: close the child ends and start draining the pipes;
+ * on spawn failure pass pid = -1 to release everything */
+int capture_attach(struct capture *cap, struct reaper *r,
+                   struct capture_child *cc, const char *name, pid_t pid);
+/* finish a frame parked on a full multiplexed log, waiting for room if
+ * needed; call before writing anything else to the same fd */
+void capture_sync(struct capture *cap, struct reaper *r);
+
+#endif
@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "cgroup.h"
+
+/* how long to wait for killed leftovers to leave a leaf before rmdir when
+ * it cannot be retried later */
+#define CGROUP_DRAIN_TRIES 100
+
+static int write_file(int dirfd, const char *file, const char *val)
+{
+    int fd = openat(dirfd, file, O_WRONLY | O_CLOEXEC);
+    ssize_t n;
+
+    if (fd < 0)
+        return -1;
+    n = write(fd, val, strlen(val));
+    close(fd);
+    return n < 0 ? -1 : 0;
+}
+
+static int read_file(int dirfd, const char *file, char *buf, size_t len)
+{
+    int fd = openat(dirfd, file, O_RDONLY | O_CLOEXEC);
+    ssize_t n;
+
+    if (fd < 0)
+        return -1;
+    n = read(fd, buf, len - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return 0;
+}
+
+int cgroup_prepare_parent(const char *parent)
+{
+    static const char *const ctrls[] = { "+memory", "+cpu", "+pids" };
+    int dirfd, ret = 0;
+    size_t i;
+
+    dirfd = open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) {
+        perror(parent);
+        return -1;
+    }
+    /* one at a time, so a missing controller does not block the others */
+    for (i = 0; i < sizeof(ctrls) / sizeof(ctrls[0]); i++) {
+        if (write_file(dirfd, "cgroup.subtree_control", ctrls[i]) < 0) {
+            fprintf(stderr, "%s: cannot enable %s controller: %s\n", parent,
+                    ctrls[i] + 1, strerror(errno));
+            ret = -1;
+        }
+    }
+    close(dirfd);
+    return ret;
+}
+
+static void set_limit(struct cgroup_leaf *leaf, const char *file,
+                      const char *val)
+{
+    if (write_file(leaf->fd, file, val) < 0)
+        fprintf(stderr, "%s/%s: %s\n", leaf->path, file, strerror(errno));
+}
+
+int cgroup_leaf_create(struct cgroup_leaf *leaf, const char *parent,
+                       const char *name, const struct cgroup_limits *lim)
+{
+    char val[64];
+
+    snprintf(leaf->path, sizeof(leaf->path), "%s/%s", parent, name);
+    leaf->fd = -1;
+    if (mkdir(leaf->path, 0755) < 0 && errno != EEXIST) {
+        perror(leaf->path);
+        return -1;
+    }
+    leaf->fd = open(leaf->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (leaf->fd < 0) {
+        perror(leaf->path);
+        rmdir(leaf->path);
+        return -1;
+    }
+
+    if (lim->memory_max > 0) {
+        snprintf(val, sizeof(val), "%lld", lim->memory_max);
+        set_limit(leaf, "memory.max", val);
+    }
+    if (lim->cpu_quota_us > 0) {
+        snprintf(val, sizeof(val), "%ld %ld", lim->cpu_quota_us,
+                 lim->cpu_period_us);
+        set_limit(leaf, "cpu.max", val);
+    }
+    if (lim->pids_max > 0) {
+        snprintf(val, sizeof(val), "%ld", lim->pids_max);
+        set_limit(leaf, "pids.max", val);
+    }
+    return 0;
+}
+
+static int64_t stat_field(const char *buf, const char *key)
+{
+    size_t len = strlen(key);
+    const char *p = buf;
+
+    while ((p = strstr(p, key)) != NULL) {
+        if ((p == buf || p[-1] == '\n') && p[len] == ' ')
+            return strtoll(p + len + 1, NULL, 10);
+        p += len;
+    }
+    return 0;
+}
+
+void cgroup_leaf_stats(const struct cgroup_leaf *leaf,
+                       struct cgroup_stats *st)
+{
+    char buf[1024];
+
+    memset(st, 0, sizeof(*st));
+    st->memory_peak = -1;
+    if (leaf->fd < 0)
+        return;
+    if (read_file(leaf->fd, "memory.peak", buf, sizeof(buf)) == 0)
+        st->memory_peak = strtoll(buf, NULL, 10);
+    if (read_file(leaf->fd, "cpu.stat", buf, sizeof(buf)) == 0) {
+        st->usage_usec = stat_field(buf, "usage_usec");
+        st->user_usec = stat_field(buf, "user_usec");
+        st->system_usec = stat_field(buf, "system_usec");
+        st->nr_throttled = stat_field(buf, "nr_throttled");
+        st->throttled_usec = stat_field(buf, "throttled_usec");
+    }
+}
+
+/* 0 when the leaf is gone (or cannot be removed, which is reported),
+ * 1 while killed tasks are still leaving it */
+static int leaf_rmdir(const char *path)
+{
+    if (rmdir(path) == 0)
+        return 0;
+    if (errno == EBUSY)
+        return 1;
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return 0;
+}
+
+/* block until the leaf can be removed, for at most CGROUP_DRAIN_TRIES ms */
+static void leaf_drain(const char *path)
+{
+    struct timespec ts = { 0, 1000000 };
+    int i;
+
+    for (i = 0; i < CGROUP_DRAIN_TRIES; i++) {
+        if (!leaf_rmdir(path))
+            return;
+        nanosleep(&ts, NULL);
+    }
+    fprintf(stderr, "%s: %s\n", path, strerror(EBUSY));
+}
+
+static int pending_add(struct cgroup_pending *pending, const char *path)
+{
+    char *copy;
+
+    if (pending->n == pending->cap) {
+        int cap = pending->cap ? pending->cap * 2 : 16;
+        char **paths = realloc(pending->paths, cap * sizeof(*paths));
+
+        if (!paths)
+            return -1;
+        pending->paths = paths;
+        pending->cap = cap;
+    }
+    copy = strdup(path);
+    if (!copy)
+        return -1;
+    pending->paths[pending->n++] = copy;
+    return 0;
+}
+
+void cgroup_leaf_destroy(struct cgroup_leaf *leaf,
+                         struct cgroup_pending *pending)
+{
+    if (leaf->fd < 0)
+        return;
+    /* grandchildren outlive the child we reaped; cgroup.kill (5.14+)
+     * takes them all down so the leaf can go */
+    write_file(leaf->fd, "cgroup.kill", "1");
+    close(leaf->fd);
+    leaf->fd = -1;
+    if (!leaf_rmdir(leaf->path))
+        return;
+    if (!pending || pending_add(pending, leaf->path) < 0)
+        leaf_drain(leaf->path);
+}
+
+int cgroup_pending_retry(struct cgroup_pending *pending)
+{
+    int i, n = 0;
+
+    for (i = 0; i < pending->n; i++) {
+        if (leaf_rmdir(pending->paths[i]))
+            pending->paths[n++] = pending->paths[i];
+        else
+            free(pending->paths[i]);
+    }
+    pending->n = n;
+    return n;
+}
+
+void cgroup_pending_drain(struct cgroup_pending *pending)
+{
+    int i;
+
+    for (i = 0; i < pending->n; i++) {
+        leaf_drain(pending->paths[i]);
+        free(pending->paths[i]);
+    }
+    free(pending->paths);
+    pending->paths = NULL;
+    pending->n = pending->cap = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <stdint.h>
+
+/*
+ * cgroup v2 sandboxes for supervised children.
+ *
+ * Every child (or the whole batch) gets a leaf below a delegated parent
+ * cgroup with memory.max, cpu.max and pids.max applied. The leaf's
+ * directory fd is handed to spawn_child(), which starts the child directly
+ * inside it with clone3(CLONE_INTO_CGROUP) or, where that is unavailable,
+ * lets the child move itself in before exec, so it never runs outside the
+ * limits. memory.peak and cpu.stat are read back when the leaf is done.
+ */
+
+struct cgroup_limits {
+    long long memory_max;   /* bytes, 0 for no limit */
+    long cpu_quota_us;      /* per cpu_period_us, 0 for no limit */
+    long cpu_period_us;
+    long pids_max;          /* 0 for no limit */
+};
+
+struct cgroup_stats {
+    int64_t memory_peak;    /* bytes, -1 if unavailable */
+    int64_t usage_usec;
+    int64_t user_usec;
+    int64_t system_usec;
+    int64_t nr_throttled;
+    int64_t throttled_usec;
+};
+
+struct cgroup_leaf {
+    int fd;                 /* O_DIRECTORY fd, -1 if not created */
+    char path[4096];
+};
+
+/* enable the memory, cpu and pids controllers for the parent's children */
+int cgroup_prepare_parent(const char *parent);
+
+int cgroup_leaf_create(struct cgroup_leaf *leaf, const char *parent,
+                       const char *name, const struct cgroup_limits *lim);
+void cgroup_leaf_stats(const struct cgroup_leaf *leaf,
+                       struct cgroup_stats *st);
+/* leaves whose rmdir waits for killed tasks to leave; zero-initialize */
+struct cgroup_pending {
+    char **paths;
+    int n;
+    int cap;
+};
+
+/* kill whatever is left in the leaf and remove it. A leaf that is still
+ * busy is queued on pending for cgroup_pending_retry(), so an event loop
+ * never sleeps on it; with pending NULL it is waited for here. */
+void cgroup_leaf_destroy(struct cgroup_leaf *leaf,
+                         struct cgroup_pending *pending);
+/* try every queued rmdir once; returns how many leaves are still busy */
+int cgroup_pending_retry(struct cgroup_pending *pending);
+/* wait for the queued leaves (briefly each) and free the list */
+void cgroup_pending_drain(struct cgroup_pending *pending);
+
+#endif
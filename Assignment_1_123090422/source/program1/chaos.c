@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "../common/sigtab.h"
+
+/*
+ * Configurable test child for soak runs (see chaosgen). Its fate comes from
+ * the options, or from the CHAOS_* variable named after each one when the
+ * option is absent, and is carried out in this order:
+ *
+ *   -m BYTES  CHAOS_MEM         allocate and touch BYTES (exit 111 on ENOMEM)
+ *   -f DEPTH  CHAOS_FORK_DEPTH  fork a binary tree of DEPTH levels and reap it
+ *   -s MS     CHAOS_SLEEP_MS    sleep
+ *   -z        CHAOS_STOP=1      stop with SIGSTOP, carry on if continued
+ *   -k SIG    CHAOS_SIGNAL      raise SIG, a number or a name like SIGSEGV
+ *   -x CODE   CHAOS_EXIT        exit with CODE (default 0)
+ *
+ * Core dumps are disabled unless -c is given, so crashing fates do not fill
+ * the disk during a soak.
+ */
+
+#define CHAOS_ENOMEM 111
+#define CHAOS_MAX_DEPTH 12
+
+static const char *opt_env(const char *val, const char *var)
+{
+    return val ? val : getenv(var);
+}
+
+static int parse_signal(const char *s)
+{
+    char *end;
+    long n = strtol(s, &end, 10);
+    int sig;
+
+    if (*s && !*end)
+        return n;
+    for (sig = 1; sig < SIGTAB_NSIG; sig++)
+        if (sigtab_get(sig) && strcmp(sigtab_name(sig), s) == 0)
+            return sig;
+    return -1;
+}
+
+static void touch_memory(size_t bytes)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    char *p = malloc(bytes);
+    size_t off;
+
+    if (!p)
+        exit(CHAOS_ENOMEM);
+    for (off = 0; off < bytes; off += page)
+        p[off] = 1;
+}
+
+/* deliver sig with its default action: an inherited SIG_IGN or blocked
+ * mask (SIGINT and SIGQUIT under & or nohup) would turn the fate into a
+ * plain exit */
+static void raise_default(int sig)
+{
+    sigset_t set;
+
+    signal(sig, SIG_DFL);
+    sigemptyset(&set);
+    sigaddset(&set, sig);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+    raise(sig);
+}
+
+/* every level forks two children and waits for both */
+static void fork_tree(int depth)
+{
+    pid_t kids[2];
+    int i;
+
+    if (depth <= 0)
+        return;
+    for (i = 0; i < 2; i++) {
+        kids[i] = fork();
+        if (kids[i] == 0) {
+            fork_tree(depth - 1);
+            _exit(0);
+        }
+    }
+    for (i = 0; i < 2; i++)
+        if (kids[i] > 0)
+            waitpid(kids[i], NULL, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *mem = NULL, *depth = NULL, *sleep_ms = NULL, *stop = NULL;
+    const char *sig = NULL, *code = NULL;
+    int core = 0, opt, signo = 0;
+
+    while ((opt = getopt(argc, argv, "m:f:s:zk:x:c")) != -1) {
+        switch (opt) {
+        case 'm':
+            mem = optarg;
+            break;
+        case 'f':
+            depth = optarg;
+            break;
+        case 's':
+            sleep_ms = optarg;
+            break;
+        case 'z':
+            stop = "1";
+            break;
+        case 'k':
+            sig = optarg;
+            break;
+        case 'x':
+            code = optarg;
+            break;
+        case 'c':
+            core = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-m bytes] [-f depth] [-s ms] [-z] "
+                    "[-k signal] [-x code] [-c]\n", argv[0]);
+            return 2;
+        }
+    }
+    mem = opt_env(mem, "CHAOS_MEM");
+    depth = opt_env(depth, "CHAOS_FORK_DEPTH");
+    sleep_ms = opt_env(sleep_ms, "CHAOS_SLEEP_MS");
+    stop = opt_env(stop, "CHAOS_STOP");
+    sig = opt_env(sig, "CHAOS_SIGNAL");
+    code = opt_env(code, "CHAOS_EXIT");
+    if (sig) {
+        signo = parse_signal(sig);
+        if (signo <= 0 || signo >= SIGTAB_NSIG) {
+            fprintf(stderr, "%s: unknown signal %s\n", argv[0], sig);
+            return 2;
+        }
+    }
+
+    if (!core) {
+        struct rlimit rl = { 0, 0 };
+
+        setrlimit(RLIMIT_CORE, &rl);
+    }
+    if (mem)
+        touch_memory(strtoull(mem, NULL, 0));
+    if (depth) {
+        int d = atoi(depth);
+
+        fork_tree(d < CHAOS_MAX_DEPTH ? d : CHAOS_MAX_DEPTH);
+    }
+    if (sleep_ms) {
+        long ms = atol(sleep_ms);
+        struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+
+        while (nanosleep(&ts, &ts) < 0)
+            ;
+    }
+    if (stop && atoi(stop))
+        raise(SIGSTOP);
+    if (signo)
+        raise_default(signo);
+    return code ? atoi(code) : 0;
+}
@@ -0,0 +1,651 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "daemon.h"
+#include "../common/sigtab.h"
+#include "../program2/program2_ring.h"
+
+/*
+ * Fault-injection driver for the supervisors. Every launch runs the chaos
+ * child with a fate drawn from a weighted mix, and the outcome the
+ * supervisor reports is checked against what that fate must produce:
+ *
+ *   chaosgen -s SOCKET [options] ./chaos   program1 --daemon, paced at -r
+ *   chaosgen -k MODULE [options] ./chaos   program2.ko (root), 64 per insmod
+ *
+ * The mix (-m) is a comma separated list of kind=weight over exit, signal,
+ * stop, sleep, mem and fork. Signals are drawn from every signal except
+ * the job control stops that orphaned process groups ignore and the two
+ * glibc keeps for itself. A stopped child is killed by both supervisors, so
+ * the daemon must report SIGKILL and program2 must report the stop first.
+ * The run is reproducible with the seed it prints (-S).
+ */
+
+#define CHAOS_MAX_ARGS 12
+#define PROGRAM2_BATCH 64       /* PROGRAM2_MAX_TARGETS */
+#define MAX_REPORTED 10
+
+enum fate_kind {
+    FATE_EXIT,
+    FATE_SIGNAL,
+    FATE_STOP,
+    FATE_SLEEP,
+    FATE_MEM,
+    FATE_FORK,
+    NR_FATES,
+};
+
+static const char *const fate_names[NR_FATES] = {
+    "exit", "signal", "stop", "sleep", "mem", "fork",
+};
+
+struct fate {
+    uint8_t kind;
+    uint8_t code;           /* exit code at the end of every fate */
+    uint8_t signo;          /* FATE_SIGNAL */
+    uint32_t arg;           /* sleep ms, MiB or fork depth */
+};
+
+/* what the supervisor has to report, and what it did */
+struct outcome {
+    int outcome;            /* enum report_outcome */
+    int code;
+    int signo;
+    int core;
+};
+
+static int weights[NR_FATES] = { 30, 40, 10, 10, 5, 5 };
+static int max_sleep_ms = 50, max_mem_mb = 16, max_depth = 4;
+static int signals[SIGTAB_NSIG], nsignals;
+static uint64_t rng_state;
+static int verbose;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* xorshift64*, good enough for picking fates */
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 0x2545f4914f6cdd1dull) >> 32;
+}
+
+static uint32_t rng_below(uint32_t n)
+{
+    return n ? rng_next() % n : 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s -s SOCKET | -k MODULE [-n count] [-r rate] "
+            "[-c in_flight] [-S seed] [-m kind=weight,...] [-v] chaos\n",
+            prog);
+}
+
+static int parse_mix(char *mix)
+{
+    char *save = NULL, *tok;
+    int i;
+
+    memset(weights, 0, sizeof(weights));
+    for (tok = strtok_r(mix, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+
+        if (!eq)
+            return -1;
+        *eq = '\0';
+        for (i = 0; i < NR_FATES; i++)
+            if (strcmp(tok, fate_names[i]) == 0)
+                break;
+        if (i == NR_FATES)
+            return -1;
+        weights[i] = atoi(eq + 1);
+    }
+    return 0;
+}
+
+static void init_signals(void)
+{
+    int sig;
+
+    for (sig = 1; sig < SIGTAB_NSIG; sig++) {
+        if (!sigtab_get(sig) || sig == SIGTSTP || sig == SIGTTIN ||
+            sig == SIGTTOU || sig == 32 || sig == 33)
+            continue;
+        signals[nsignals++] = sig;
+    }
+}
+
+static void pick_fate(struct fate *f)
+{
+    int total = 0, i;
+    uint32_t r;
+
+    for (i = 0; i < NR_FATES; i++)
+        total += weights[i];
+    r = rng_below(total);
+    for (i = 0; i < NR_FATES - 1 && r >= (uint32_t)weights[i]; i++)
+        r -= weights[i];
+    memset(f, 0, sizeof(*f));
+    f->kind = i;
+    f->code = rng_below(256);
+    switch (f->kind) {
+    case FATE_SIGNAL:
+        f->signo = signals[rng_below(nsignals)];
+        break;
+    case FATE_SLEEP:
+        f->arg = rng_below(max_sleep_ms + 1);
+        break;
+    case FATE_MEM:
+        f->arg = 1 + rng_below(max_mem_mb);
+        break;
+    case FATE_FORK:
+        f->arg = 1 + rng_below(max_depth);
+        break;
+    }
+}
+
+/* argv for the chaos child; bufs backs the numbers */
+static int fate_argv(const struct fate *f, const char *path, char **argv,
+                     char bufs[][24])
+{
+    int argc = 0, nbuf = 0;
+
+#define ADD_NUM(opt, fmt, val) do { \
+        argv[argc++] = opt; \
+        snprintf(bufs[nbuf], sizeof(bufs[0]), fmt, val); \
+        argv[argc++] = bufs[nbuf++]; \
+    } while (0)
+
+    argv[argc++] = (char *)path;
+    switch (f->kind) {
+    case FATE_SIGNAL:
+        argv[argc++] = "-k";
+        argv[argc++] = (char *)sigtab_name(f->signo);
+        break;
+    case FATE_STOP:
+        argv[argc++] = "-z";
+        break;
+    case FATE_SLEEP:
+        ADD_NUM("-s", "%u", f->arg);
+        break;
+    case FATE_MEM:
+        ADD_NUM("-m", "%llu", (unsigned long long)f->arg << 20);
+        break;
+    case FATE_FORK:
+        ADD_NUM("-f", "%u", f->arg);
+        break;
+    }
+    ADD_NUM("-x", "%u", f->code);
+    argv[argc] = NULL;
+#undef ADD_NUM
+    return argc;
+}
+
+/* ground truth; a stop ends in SIGKILL unless the stop itself is reported */
+static void fate_expect(const struct fate *f, int report_stop,
+                        struct outcome *o)
+{
+    const struct sigtab_entry *e = sigtab_get(f->signo);
+    int stops = f->kind == FATE_STOP ||
+                (f->kind == FATE_SIGNAL && e->action == SIGTAB_STOP);
+
+    memset(o, 0, sizeof(*o));
+    if (stops) {
+        o->outcome = report_stop ? OUTCOME_STOPPED : OUTCOME_SIGNALED;
+        o->signo = report_stop ? SIGSTOP : SIGKILL;
+    } else if (f->kind == FATE_SIGNAL &&
+               (e->action == SIGTAB_TERM || e->action == SIGTAB_CORE)) {
+        /* chaos turns core dumps off */
+        o->outcome = OUTCOME_SIGNALED;
+        o->signo = f->signo;
+    } else {
+        o->outcome = OUTCOME_EXITED;
+        o->code = f->code;
+    }
+}
+
+static int outcome_equal(const struct outcome *a, const struct outcome *b)
+{
+    return a->outcome == b->outcome && a->core == b->core &&
+           (a->outcome == OUTCOME_EXITED ? a->code == b->code :
+            a->signo == b->signo);
+}
+
+static const char *outcome_str(const struct outcome *o, char *buf,
+                               size_t len)
+{
+    switch (o->outcome) {
+    case OUTCOME_EXITED:
+        snprintf(buf, len, "exited %d", o->code);
+        break;
+    case OUTCOME_SIGNALED:
+    case OUTCOME_STOPPED:
+        snprintf(buf, len, "%s %s%s", o->outcome == OUTCOME_STOPPED ?
+                 "stopped by" : "killed by", sigtab_name(o->signo),
+                 o->core ? " (core dumped)" : "");
+        break;
+    case OUTCOME_TIMEOUT:
+        snprintf(buf, len, "timed out");
+        break;
+    default:
+        snprintf(buf, len, "outcome %d", o->outcome);
+    }
+    return buf;
+}
+
+struct tally {
+    int count[NR_FATES];
+    int wrong[NR_FATES];
+    int failed;             /* launches that never ran */
+    int reported;
+};
+
+static void check(struct tally *t, uint64_t id, const struct fate *f,
+                  int report_stop, const struct outcome *got,
+                  const char *path)
+{
+    struct outcome want;
+    char a[64], b[64], bufs[CHAOS_MAX_ARGS][24];
+    char *argv[CHAOS_MAX_ARGS];
+    int argc, i;
+
+    fate_expect(f, report_stop, &want);
+    t->count[f->kind]++;
+    if (outcome_equal(&want, got))
+        return;
+    t->wrong[f->kind]++;
+    if (!verbose && t->reported++ >= MAX_REPORTED)
+        return;
+    argc = fate_argv(f, path, argv, bufs);
+    printf("launch %llu:", (unsigned long long)id);
+    for (i = 0; i < argc; i++)
+        printf(" %s", argv[i]);
+    printf(": expected %s, got %s\n", outcome_str(&want, a, sizeof(a)),
+           outcome_str(got, b, sizeof(b)));
+}
+
+static size_t build_req(char *buf, char **argv, int argc, uint64_t tag)
+{
+    struct daemon_req *req = (struct daemon_req *)buf;
+    size_t len = sizeof(*req);
+    int i;
+
+    memset(req, 0, sizeof(*req));
+    req->version = DAEMON_PROTO_VERSION;
+    req->argc = argc;
+    req->tag = tag;
+    for (i = -1; i < argc; i++) {
+        const char *s = argv[i < 0 ? 0 : i];
+        size_t n = strlen(s) + 1;
+
+        memcpy(buf + len, s, n);
+        len += n;
+    }
+    req->size = len;
+    return len;
+}
+
+/* open loop: launch n is due at start + n / rate, whatever came back */
+static int run_daemon_backend(const char *sock, const char *path,
+                              struct fate *fates, int count, int rate,
+                              int window, struct tally *t, uint64_t *lat)
+{
+    static uint64_t buf[DAEMON_MSG_MAX / sizeof(uint64_t)];
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    uint64_t *sent, *retry, start;
+    int next = 0, done = 0, inflight = 0, nretry = 0, fd;
+
+    if (strlen(sock) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", sock);
+        return -1;
+    }
+    strcpy(addr.sun_path, sock);
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror(sock);
+        return -1;
+    }
+    sent = calloc(count, sizeof(*sent));
+    retry = calloc(count, sizeof(*retry));
+    if (!sent || !retry) {
+        perror("calloc");
+        return -1;
+    }
+
+    start = now_ns();
+    while (done < count) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        uint64_t now = now_ns(), due = 0;
+        int timeout = -1;
+
+        while (inflight < window && (nretry > 0 || next < count)) {
+            char bufs[CHAOS_MAX_ARGS][24];
+            char *argv[CHAOS_MAX_ARGS];
+            int resend = nretry > 0, argc;
+            uint64_t tag;
+            size_t len;
+
+            if (!resend && rate > 0) {
+                due = start + (uint64_t)next * 1000000000ull / rate;
+                if (due > now)
+                    break;
+            }
+            tag = resend ? retry[nretry - 1] : (uint64_t)next;
+            argc = fate_argv(&fates[tag], path, argv, bufs);
+            len = build_req((char *)buf, argv, argc, tag);
+            if (send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+                if (errno != EAGAIN) {
+                    perror("send");
+                    return -1;
+                }
+                pfd.events |= POLLOUT;
+                break;
+            }
+            if (resend)
+                nretry--;
+            else
+                sent[next++] = now_ns();
+            inflight++;
+        }
+        if (!(pfd.events & POLLOUT) && !nretry && next < count &&
+            inflight < window && due > now)
+            timeout = (due - now + 999999) / 1000000;
+        if (poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+            perror("poll");
+            return -1;
+        }
+        if (pfd.revents & (POLLERR | POLLHUP)) {
+            fprintf(stderr, "daemon closed the connection after %d results\n",
+                    done);
+            return -1;
+        }
+        for (;;) {
+            struct daemon_result res;
+            struct outcome got;
+            ssize_t n = recv(fd, &res, sizeof(res), MSG_DONTWAIT);
+
+            if (n < 0 && errno == EAGAIN)
+                break;
+            if (n != sizeof(res) || res.tag >= (uint64_t)count) {
+                fprintf(stderr, "bad result from daemon\n");
+                return -1;
+            }
+            inflight--;
+            if (res.err == EAGAIN) {
+                retry[nretry++] = res.tag;
+                continue;
+            }
+            lat[done++] = now_ns() - sent[res.tag];
+            if (res.err) {
+                t->failed++;
+                continue;
+            }
+            got.outcome = res.rec.outcome;
+            got.code = res.rec.exit_code;
+            got.signo = res.rec.signo;
+            got.core = res.rec.core_dumped;
+            check(t, res.tag, &fates[res.tag], 0, &got, path);
+        }
+    }
+    close(fd);
+    free(sent);
+    free(retry);
+    return done;
+}
+
+static int run_cmd(char **argv)
+{
+    int status;
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+        return -1;
+    return 0;
+}
+
+static char *append(char *s, size_t *len, const char *add)
+{
+    size_t n = strlen(add);
+
+    s = realloc(s, *len + n + 1);
+    if (!s) {
+        perror("realloc");
+        exit(1);
+    }
+    memcpy(s + *len, add, n + 1);
+    *len += n;
+    return s;
+}
+
+/* one insmod per batch; results come back through read() of the ring */
+static int program2_batch(const char *module, const char *path,
+                          struct fate *fates, int first, int n, int window,
+                          struct tally *t, uint64_t *lat)
+{
+    struct p2_record recs[64];
+    char *paths = NULL, *args = NULL;
+    size_t plen = 0, alen = 0;
+    char inflight[32], ring[32];
+    char *insmod[] = { "insmod", (char *)module, NULL, NULL, inflight,
+                       ring, NULL };
+    char *rmmod[] = { "rmmod", "program2", NULL };
+    char seen[PROGRAM2_BATCH] = { 0 };
+    int want = n, got = 0, fd, i, j;
+
+    paths = append(paths, &plen, "paths=");
+    /* quoted, or the kernel splits the arguments at the spaces */
+    args = append(args, &alen, "args=\"");
+    for (i = 0; i < n; i++) {
+        char bufs[CHAOS_MAX_ARGS][24];
+        char *argv[CHAOS_MAX_ARGS];
+        int argc = fate_argv(&fates[first + i], path, argv, bufs);
+        struct outcome o;
+
+        fate_expect(&fates[first + i], 1, &o);
+        /* the stop and the SIGKILL that follows are both recorded */
+        want += o.outcome == OUTCOME_STOPPED;
+        if (i) {
+            paths = append(paths, &plen, ",");
+            args = append(args, &alen, ",");
+        }
+        paths = append(paths, &plen, path);
+        for (j = 1; j < argc; j++) {
+            if (j > 1)
+                args = append(args, &alen, " ");
+            args = append(args, &alen, argv[j]);
+        }
+    }
+    args = append(args, &alen, "\"");
+    insmod[2] = paths;
+    insmod[3] = args;
+    snprintf(inflight, sizeof(inflight), "max_inflight=%d", window);
+    snprintf(ring, sizeof(ring), "ring_records=%d", 2 * want);
+    if (run_cmd(insmod) < 0) {
+        fprintf(stderr, "insmod %s failed\n", module);
+        return -1;
+    }
+    fd = open("/dev/program2", O_RDONLY);
+    if (fd < 0) {
+        perror("/dev/program2");
+        run_cmd(rmmod);
+        return -1;
+    }
+    while (got < want) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        ssize_t len;
+
+        /* every fate ends within a second; a silent ring means lost
+         * children */
+        if (poll(&pfd, 1, 10000) <= 0)
+            break;
+        len = read(fd, recs, sizeof(recs));
+        if (len < 0) {
+            perror("read");
+            break;
+        }
+        for (i = 0; i < len / (ssize_t)sizeof(recs[0]); i++) {
+            const struct p2_record *rec = &recs[i];
+            struct outcome o;
+
+            got++;
+            if (rec->target >= (uint32_t)n || seen[rec->target]++)
+                continue;
+            o.outcome = rec->exited ? OUTCOME_EXITED : rec->stopped ?
+                        OUTCOME_STOPPED : OUTCOME_SIGNALED;
+            o.code = rec->exit_code;
+            o.signo = rec->signo;
+            o.core = rec->core_dumped;
+            lat[first + rec->target] = rec->end_ns - rec->start_ns;
+            check(t, first + rec->target, &fates[first + rec->target], 1,
+                  &o, path);
+        }
+    }
+    close(fd);
+    run_cmd(rmmod);
+    for (i = 0; i < n; i++)
+        if (!seen[i])
+            t->failed++;
+    free(paths);
+    free(args);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *sock = NULL, *module = NULL, *path;
+    int count = 10000, rate = 1000, window = 256, opt, i, done;
+    uint64_t seed = now_ns(), start, elapsed, *lat;
+    struct fate *fates;
+    struct tally t;
+    int wrong = 0;
+
+    while ((opt = getopt(argc, argv, "s:k:n:r:c:S:m:vh")) != -1) {
+        switch (opt) {
+        case 's':
+            sock = optarg;
+            break;
+        case 'k':
+            module = optarg;
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'r':
+            rate = atoi(optarg);
+            break;
+        case 'c':
+            window = atoi(optarg);
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'm':
+            if (parse_mix(optarg) < 0) {
+                fprintf(stderr, "bad mix: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!sock == !module || optind >= argc || count <= 0 || window <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    path = argv[optind];
+    for (i = 0; i < NR_FATES && weights[i] <= 0; i++)
+        ;
+    if (i == NR_FATES) {
+        fprintf(stderr, "the mix has no positive weight\n");
+        return 1;
+    }
+
+    rng_state = seed ? seed : 1;
+    init_signals();
+    fates = calloc(count, sizeof(*fates));
+    lat = calloc(count, sizeof(*lat));
+    if (!fates || !lat) {
+        perror("calloc");
+        return 1;
+    }
+    for (i = 0; i < count; i++)
+        pick_fate(&fates[i]);
+    memset(&t, 0, sizeof(t));
+    printf("seed %llu\n", (unsigned long long)seed);
+
+    start = now_ns();
+    if (sock) {
+        done = run_daemon_backend(sock, path, fates, count, rate, window,
+                                  &t, lat);
+        if (done < 0)
+            return 1;
+    } else {
+        for (i = 0; i < count; i += PROGRAM2_BATCH)
+            if (program2_batch(module, path, fates, i,
+                               count - i < PROGRAM2_BATCH ?
+                               count - i : PROGRAM2_BATCH,
+                               window, &t, lat) < 0)
+                return 1;
+        done = count;
+    }
+    elapsed = now_ns() - start;
+
+    printf("%d launches in %.3fs: %.0f launches/s", done, elapsed / 1e9,
+           done / (elapsed / 1e9));
+    if (sock && rate > 0)
+        printf(" (target %d/s)", rate);
+    printf(", %d failed\n", t.failed);
+    printf("%-8s %8s %8s\n", "fate", "count", "wrong");
+    for (i = 0; i < NR_FATES; i++) {
+        printf("%-8s %8d %8d\n", fate_names[i], t.count[i], t.wrong[i]);
+        wrong += t.wrong[i];
+    }
+    qsort(lat, done, sizeof(*lat), cmp_u64);
+    printf("latency: p50 %.1fus p99 %.1fus max %.1fus\n",
+           lat[done / 2] / 1e3, lat[(size_t)(done * 0.99)] / 1e3,
+           lat[done - 1] / 1e3);
+    printf("%d of %d outcomes matched the injected fate\n",
+           done - t.failed - wrong, done);
+    return wrong || t.failed ? 1 : 0;
+}
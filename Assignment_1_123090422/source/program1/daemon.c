@@ -0,0 +1,627 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+#include "reaper.h"
+
+#define MAX_CLIENTS 1024
+/* requests drained from one client before the others get a turn */
+#define CLIENT_BATCH 64
+/* launches started per wakeup, so exits get reaped in between */
+#define ZYGOTE_BATCH 64
+/* lets a few thousand requests queue up in front of the zygote */
+#define ZYGOTE_SNDBUF (4 << 20)
+#define CLIENT_SNDBUF (1 << 20)
+
+/* put in front of every request to the zygote and echoed in front of every
+ * result, so the daemon knows which client to answer */
+struct route {
+    uint32_t slot;
+    uint32_t gen;
+};
+
+static uint64_t ts_ns(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+static void set_sndbuf(int fd, int size)
+{
+    /* SO_SNDBUFFORCE ignores wmem_max but needs CAP_NET_ADMIN */
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &size, sizeof(size)) < 0)
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+}
+
+/*
+ * zygote: spawns and reaps the children, one result per launch
+ */
+
+struct zjob {
+    struct route route;
+    uint64_t tag;
+    pid_t pid;
+    int limit_hit;          /* enum report_limit */
+    int cpu_limited;
+    struct timespec start;
+    struct timespec start_real;
+    struct reaper_watch *wall_timer;
+    char program[64];
+    struct zjob *next;
+    struct zjob **pprev;
+};
+
+struct zygote {
+    struct reaper reaper;
+    enum spawn_mode mode;
+    int ctrl;
+    int devnull;
+    int closing;
+    struct zjob *jobs;      /* running children */
+};
+
+#define container_of_zygote(r) \
+    ((struct zygote *)((char *)(r) - offsetof(struct zygote, reaper)))
+
+static void zygote_send(struct zygote *z, const struct route *route,
+                        const struct daemon_result *res)
+{
+    struct iovec iov[2] = {
+        { (void *)route, sizeof(*route) },
+        { (void *)res, sizeof(*res) },
+    };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+
+    /* blocking: the daemon never blocks on us, so it always drains */
+    while (sendmsg(z->ctrl, &msg, MSG_NOSIGNAL) < 0 && errno == EINTR)
+        ;
+}
+
+static void zygote_fail(struct zygote *z, const struct route *route,
+                        uint64_t tag, int err)
+{
+    struct daemon_result res;
+
+    memset(&res, 0, sizeof(res));
+    res.tag = tag;
+    res.err = err;
+    zygote_send(z, route, &res);
+}
+
+static void zjob_wall_expired(struct reaper *r, struct reaper_watch *w,
+                              uint32_t events)
+{
+    struct zjob *job = w->data;
+
+    job->wall_timer = NULL;
+    job->limit_hit = LIMIT_WALL;
+    kill(job->pid, SIGKILL);
+}
+
+static void zjob_event(struct reaper *r, struct reaper_watch *w, int status,
+                       const struct rusage *ru)
+{
+    struct zygote *z = container_of_zygote(r);
+    struct zjob *job = w->data;
+    struct daemon_result res;
+    struct timespec end;
+
+    /* nobody is around to resume a stopped child */
+    if (WIFSTOPPED(status)) {
+        kill(job->pid, SIGKILL);
+        return;
+    }
+    if (WIFCONTINUED(status))
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (job->wall_timer)
+        reaper_remove(r, job->wall_timer);
+    memset(&res, 0, sizeof(res));
+    res.tag = job->tag;
+    report_fill(&res.rec, job->pid, status, ru);
+    if (job->limit_hit) {
+        res.rec.outcome = OUTCOME_TIMEOUT;
+        res.rec.limit = job->limit_hit;
+    } else if (job->cpu_limited && WIFSIGNALED(status) &&
+               WTERMSIG(status) == SIGXCPU) {
+        res.rec.outcome = OUTCOME_TIMEOUT;
+        res.rec.limit = LIMIT_CPU;
+    }
+    memcpy(res.rec.program, job->program, sizeof(res.rec.program));
+    res.rec.start_ns = ts_ns(&job->start_real);
+    res.rec.wall_ns = ts_ns(&end) - ts_ns(&job->start);
+    res.rec.running_ns = res.rec.wall_ns;
+    zygote_send(z, &job->route, &res);
+
+    *job->pprev = job->next;
+    if (job->next)
+        job->next->pprev = job->pprev;
+    free(job);
+}
+
+/* split the strings behind the header; argv and envp have room for argc + 1
+ * and envc + 1 pointers */
+static int unpack_req(const struct daemon_req *req, size_t len,
+                      const char **path, char **argv, char **envp)
+{
+    char *p = (char *)(req + 1), *end = (char *)req + len, *nul;
+    size_t i, n = (size_t)1 + req->argc + req->envc;
+
+    for (i = 0; i < n; i++) {
+        if (p >= end)
+            return -1;
+        nul = memchr(p, '\0', end - p);
+        if (!nul)
+            return -1;
+        if (i == 0)
+            *path = p;
+        else if (i <= req->argc)
+            argv[i - 1] = p;
+        else
+            envp[i - 1 - req->argc] = p;
+        p = nul + 1;
+    }
+    argv[req->argc] = NULL;
+    envp[req->envc] = NULL;
+    return 0;
+}
+
+static void zygote_launch(struct zygote *z, const struct route *route,
+                          const struct daemon_req *req, size_t len)
+{
+    struct spawn_rlimit rlimits[2];
+    struct spawn_opts opts;
+    const char *path = NULL, *name;
+    struct zjob *job;
+    char **argv, **envp;
+    int err;
+
+    /* client_readable() capped both counts, so this cannot overflow */
+    argv = malloc(((size_t)req->argc + 1) * sizeof(*argv));
+    envp = malloc(((size_t)req->envc + 1) * sizeof(*envp));
+    job = calloc(1, sizeof(*job));
+    if (!argv || !envp || !job) {
+        err = ENOMEM;
+        goto fail;
+    }
+    if (unpack_req(req, len, &path, argv, envp) < 0) {
+        err = EINVAL;
+        goto fail;
+    }
+
+    spawn_opts_init(&opts);
+    opts.path = path;
+    opts.envp = req->envc ? envp : NULL;
+    opts.mask = &z->reaper.oldmask;
+    opts.stdio[0] = opts.stdio[1] = opts.stdio[2] = z->devnull;
+    opts.rlimits = rlimits;
+    if (req->cpu_sec) {
+        /* SIGXCPU at the soft limit, SIGKILL a second later */
+        rlimits[opts.nrlimits].resource = RLIMIT_CPU;
+        rlimits[opts.nrlimits].lim.rlim_cur = req->cpu_sec;
+        rlimits[opts.nrlimits].lim.rlim_max = req->cpu_sec + 1;
+        opts.nrlimits++;
+        job->cpu_limited = 1;
+    }
+    if (req->mem_bytes) {
+        rlimits[opts.nrlimits].resource = RLIMIT_AS;
+        rlimits[opts.nrlimits].lim.rlim_cur = req->mem_bytes;
+        rlimits[opts.nrlimits].lim.rlim_max = req->mem_bytes;
+        opts.nrlimits++;
+    }
+
+    job->route = *route;
+    job->tag = req->tag;
+    name = strrchr(path, '/');
+    snprintf(job->program, sizeof(job->program), "%.63s",
+             name ? name + 1 : path);
+    clock_gettime(CLOCK_REALTIME, &job->start_real);
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+    job->pid = spawn_child(z->mode, argv, &opts);
+    if (job->pid < 0) {
+        err = errno;
+        goto fail;
+    }
+    if (!reaper_add_child(&z->reaper, job->pid, zjob_event, job)) {
+        err = errno;
+        kill(job->pid, SIGKILL);
+        waitpid(job->pid, NULL, 0);
+        goto fail;
+    }
+    if (req->wall_ms)
+        job->wall_timer = reaper_add_timer(&z->reaper, req->wall_ms, 0,
+                                           zjob_wall_expired, job);
+    job->next = z->jobs;
+    if (z->jobs)
+        z->jobs->pprev = &job->next;
+    job->pprev = &z->jobs;
+    z->jobs = job;
+    free(argv);
+    free(envp);
+    return;
+
+fail:
+    zygote_fail(z, route, req->tag, err);
+    free(job);
+    free(argv);
+    free(envp);
+}
+
+static void zygote_readable(struct reaper *r, struct reaper_watch *w,
+                            uint32_t events)
+{
+    static uint64_t buf[(sizeof(struct route) + DAEMON_MSG_MAX) /
+                        sizeof(uint64_t)];
+    struct zygote *z = container_of_zygote(r);
+    const struct route *route = (const struct route *)buf;
+    const struct daemon_req *req = (const struct daemon_req *)(route + 1);
+    int i;
+
+    for (i = 0; i < ZYGOTE_BATCH; i++) {
+        ssize_t n = recv(z->ctrl, buf, sizeof(buf), MSG_DONTWAIT);
+
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            return;
+        if (n <= 0) {
+            /* the daemon went away */
+            z->closing = 1;
+            reaper_remove(r, w);
+            return;
+        }
+        /* the daemon validated the header already */
+        zygote_launch(z, route, req, n - sizeof(*route));
+    }
+}
+
+static void zygote_main(int ctrl, enum spawn_mode mode)
+{
+    struct zygote z;
+    sigset_t mask;
+
+    memset(&z, 0, sizeof(z));
+    z.ctrl = ctrl;
+    z.mode = mode;
+    z.devnull = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (z.devnull < 0 || reaper_init(&z.reaper) < 0) {
+        perror("zygote");
+        _exit(1);
+    }
+    /* the daemon decides when we stop; children get the original mask */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    if (!reaper_add_fd(&z.reaper, ctrl, EPOLLIN, zygote_readable, NULL)) {
+        perror("zygote");
+        _exit(1);
+    }
+
+    while (!z.closing || z.jobs) {
+        if (z.closing) {
+            struct zjob *job;
+
+            for (job = z.jobs; job; job = job->next)
+                kill(job->pid, SIGKILL);
+        }
+        if (reaper_run_once(&z.reaper, -1) < 0) {
+            perror("epoll_wait");
+            _exit(1);
+        }
+    }
+    _exit(0);
+}
+
+/*
+ * daemon: accepts clients and routes requests and results
+ */
+
+struct client {
+    int fd;                 /* -1 when the slot is free */
+    uint32_t gen;           /* bumped on close, stale results are dropped */
+    struct reaper_watch *watch;
+};
+
+struct daemon {
+    struct reaper reaper;
+    int listen_fd;
+    int zygote_fd;
+    pid_t zygote_pid;
+    int sigfd;
+    int stop;
+    int failed;
+    uint64_t forwarded;
+    uint64_t rejected;
+    struct client clients[MAX_CLIENTS];
+};
+
+#define container_of_daemon(r) \
+    ((struct daemon *)((char *)(r) - offsetof(struct daemon, reaper)))
+
+static void client_close(struct daemon *d, struct client *c)
+{
+    reaper_remove(&d->reaper, c->watch);
+    close(c->fd);
+    c->fd = -1;
+    c->gen++;
+}
+
+/* a client that cannot take its result right away is dropped */
+static void client_reply(struct daemon *d, struct client *c,
+                         const struct daemon_result *res)
+{
+    if (send(c->fd, res, sizeof(*res), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+        client_close(d, c);
+}
+
+static void client_reject(struct daemon *d, struct client *c, uint64_t tag,
+                          int err)
+{
+    struct daemon_result res;
+
+    memset(&res, 0, sizeof(res));
+    res.tag = tag;
+    res.err = err;
+    d->rejected++;
+    client_reply(d, c, &res);
+}
+
+/* the counts come from the client: they must be within the cap and the
+ * payload must hold that many NUL terminated strings */
+static int req_strings_ok(const struct daemon_req *req, size_t len)
+{
+    const char *p = (const char *)(req + 1), *end = (const char *)req + len;
+    size_t i, n;
+
+    if (req->argc == 0 || req->argc > DAEMON_MAX_STRINGS ||
+        req->envc > DAEMON_MAX_STRINGS - req->argc)
+        return 0;
+    n = (size_t)1 + req->argc + req->envc;
+    for (i = 0; i < n; i++) {
+        const char *nul = p < end ? memchr(p, '\0', end - p) : NULL;
+
+        if (!nul)
+            return 0;
+        p = nul + 1;
+    }
+    return 1;
+}
+
+static void client_readable(struct reaper *r, struct reaper_watch *w,
+                            uint32_t events)
+{
+    static uint64_t buf[(sizeof(struct route) + DAEMON_MSG_MAX) /
+                        sizeof(uint64_t)];
+    struct daemon *d = container_of_daemon(r);
+    struct client *c = w->data;
+    struct route *route = (struct route *)buf;
+    struct daemon_req *req = (struct daemon_req *)(route + 1);
+    int i;
+
+    for (i = 0; i < CLIENT_BATCH && c->fd >= 0; i++) {
+        ssize_t n = recv(c->fd, req, DAEMON_MSG_MAX, MSG_DONTWAIT);
+
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            return;
+        if (n <= 0) {
+            client_close(d, c);
+            return;
+        }
+        if ((size_t)n < sizeof(*req) || req->size != (size_t)n ||
+            req->version != DAEMON_PROTO_VERSION ||
+            !req_strings_ok(req, n)) {
+            client_reject(d, c, (size_t)n >= sizeof(*req) ? req->tag : 0,
+                          EINVAL);
+            continue;
+        }
+        route->slot = c - d->clients;
+        route->gen = c->gen;
+        if (send(d->zygote_fd, buf, sizeof(*route) + n,
+                 MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+            client_reject(d, c, req->tag, errno);
+            continue;
+        }
+        d->forwarded++;
+    }
+}
+
+static void daemon_accept(struct reaper *r, struct reaper_watch *w,
+                          uint32_t events)
+{
+    struct daemon *d = container_of_daemon(r);
+    int fd, slot;
+
+    while ((fd = accept4(d->listen_fd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        struct client *c = NULL;
+
+        for (slot = 0; slot < MAX_CLIENTS; slot++) {
+            if (d->clients[slot].fd < 0) {
+                c = &d->clients[slot];
+                break;
+            }
+        }
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        set_sndbuf(fd, CLIENT_SNDBUF);
+        c->watch = reaper_add_fd(r, fd, EPOLLIN, client_readable, c);
+        if (!c->watch) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+    }
+}
+
+static void zygote_results(struct reaper *r, struct reaper_watch *w,
+                           uint32_t events)
+{
+    struct daemon *d = container_of_daemon(r);
+    struct {
+        struct route route;
+        struct daemon_result res;
+    } msg;
+
+    for (;;) {
+        ssize_t n = recv(d->zygote_fd, &msg, sizeof(msg), MSG_DONTWAIT);
+        struct client *c;
+
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            return;
+        if (n <= 0) {
+            reaper_remove(r, w);
+            return;
+        }
+        if (n != sizeof(msg) || msg.route.slot >= MAX_CLIENTS)
+            continue;
+        c = &d->clients[msg.route.slot];
+        if (c->fd >= 0 && c->gen == msg.route.gen)
+            client_reply(d, c, &msg.res);
+    }
+}
+
+static void zygote_exited(struct reaper *r, struct reaper_watch *w,
+                          int status, const struct rusage *ru)
+{
+    struct daemon *d = container_of_daemon(r);
+
+    if (WIFSTOPPED(status) || WIFCONTINUED(status))
+        return;
+    fprintf(stderr, "daemon: zygote %d died (status %#x)\n",
+            d->zygote_pid, status);
+    d->zygote_pid = -1;
+    d->stop = 1;
+    d->failed = 1;
+}
+
+static void daemon_signal(struct reaper *r, struct reaper_watch *w,
+                          uint32_t events)
+{
+    struct daemon *d = container_of_daemon(r);
+    struct signalfd_siginfo ssi;
+
+    if (read(d->sigfd, &ssi, sizeof(ssi)) == sizeof(ssi))
+        d->stop = 1;
+}
+
+static int daemon_listen(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    /* a stale socket from an earlier run would make bind() fail */
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int run_daemon(const char *sock_path, enum spawn_mode mode)
+{
+    struct daemon *d;
+    sigset_t mask;
+    int sv[2], i;
+
+    /* fork the zygote while we are still small and have no clients */
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("socketpair");
+        return 1;
+    }
+    set_sndbuf(sv[0], ZYGOTE_SNDBUF);
+    set_sndbuf(sv[1], ZYGOTE_SNDBUF);
+    fflush(stdout);
+    d = calloc(1, sizeof(*d));
+    if (!d) {
+        perror("calloc");
+        return 1;
+    }
+    d->zygote_pid = fork();
+    if (d->zygote_pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (d->zygote_pid == 0) {
+        close(sv[0]);
+        zygote_main(sv[1], mode);
+    }
+    close(sv[1]);
+    d->zygote_fd = sv[0];
+    for (i = 0; i < MAX_CLIENTS; i++)
+        d->clients[i].fd = -1;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    d->sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    d->listen_fd = daemon_listen(sock_path);
+    if (d->sigfd < 0 || d->listen_fd < 0 || reaper_init(&d->reaper) < 0 ||
+        !reaper_add_child(&d->reaper, d->zygote_pid, zygote_exited, NULL) ||
+        !reaper_add_fd(&d->reaper, d->sigfd, EPOLLIN, daemon_signal, NULL) ||
+        !reaper_add_fd(&d->reaper, d->listen_fd, EPOLLIN, daemon_accept,
+                       NULL) ||
+        !reaper_add_fd(&d->reaper, d->zygote_fd, EPOLLIN, zygote_results,
+                       NULL)) {
+        perror("daemon");
+        kill(d->zygote_pid, SIGKILL);
+        waitpid(d->zygote_pid, NULL, 0);
+        return 1;
+    }
+    fprintf(stderr, "daemon: listening on %s, zygote %d, %s backend\n",
+            sock_path, d->zygote_pid, spawn_mode_name(mode));
+
+    while (!d->stop) {
+        if (reaper_run_once(&d->reaper, -1) < 0) {
+            perror("epoll_wait");
+            d->failed = 1;
+            break;
+        }
+    }
+
+    /* closing our end tells the zygote to kill its children and exit */
+    close(d->listen_fd);
+    unlink(sock_path);
+    close(d->sigfd);
+    for (i = 0; i < MAX_CLIENTS; i++)
+        if (d->clients[i].fd >= 0)
+            close(d->clients[i].fd);
+    close(d->zygote_fd);
+    reaper_destroy(&d->reaper);
+    if (d->zygote_pid > 0)
+        waitpid(d->zygote_pid, NULL, 0);
+    fprintf(stderr, "daemon: %llu launches forwarded, %llu rejected\n",
+            (unsigned long long)d->forwarded,
+            (unsigned long long)d->rejected);
+    i = d->failed;
+    free(d);
+    return i;
+}
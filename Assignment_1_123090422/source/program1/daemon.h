@@ -0,0 +1,54 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdint.h>
+
+#include "report.h"
+#include "spawn.h"
+
+/*
+ * Supervisor daemon.
+ *
+ * program1 --daemon=SOCKET forks a small zygote before it sets anything
+ * else up, then accepts launch requests on a SOCK_SEQPACKET Unix socket.
+ * Requests are forwarded to the zygote, which spawns, reaps and times the
+ * children and sends one result per launch back; the daemon routes every
+ * result to the client that asked for it. Every message is one packet, so
+ * no framing is needed on either side.
+ *
+ * Launched programs get /dev/null as stdin, stdout and stderr. Clients
+ * should bound the number of requests they keep in flight: a full queue to
+ * the zygote is answered with err = EAGAIN, and a client that stops reading
+ * its results is disconnected.
+ */
+
+#define DAEMON_PROTO_VERSION 1
+#define DAEMON_MSG_MAX 65536
+/* argc + envc; requests above it are rejected with EINVAL */
+#define DAEMON_MAX_STRINGS 4096
+
+struct daemon_req {
+    uint32_t size;          /* header plus strings */
+    uint16_t version;       /* DAEMON_PROTO_VERSION */
+    uint16_t argc;          /* at least 1 */
+    uint32_t envc;          /* 0 inherits the daemon's environment */
+    uint32_t wall_ms;       /* 0 for no limit, SIGKILL when exceeded */
+    uint64_t tag;           /* chosen by the client, echoed in the result */
+    uint32_t cpu_sec;       /* RLIMIT_CPU, 0 for no limit */
+    uint32_t pad;
+    uint64_t mem_bytes;     /* RLIMIT_AS, 0 for no limit */
+    /* followed by the NUL terminated path, argc argv strings and envc
+     * environment strings */
+};
+
+struct daemon_result {
+    uint64_t tag;
+    int32_t err;            /* 0, or the errno of a failed launch */
+    uint32_t pad;
+    struct report_record rec;   /* valid when err is 0 */
+};
+
+/* run until SIGINT or SIGTERM; returns the exit status for main() */
+int run_daemon(const char *sock_path, enum spawn_mode mode);
+
+#endif
@@ -0,0 +1,62 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <elf.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+
+#include "fault.h"
+#include "../common/sigtab.h"
+
+int fault_attach(pid_t pid)
+{
+    return ptrace(PTRACE_SEIZE, pid, NULL, NULL) < 0 ? -1 : 0;
+}
+
+static uint64_t fault_ip(pid_t pid)
+{
+    struct user_regs_struct regs;
+    struct iovec iov = { &regs, sizeof(regs) };
+
+    if (ptrace(PTRACE_GETREGSET, pid, (void *)NT_PRSTATUS, &iov) < 0)
+        return 0;
+#if defined(__x86_64__)
+    return regs.rip;
+#elif defined(__i386__)
+    return regs.eip;
+#elif defined(__aarch64__)
+    return regs.pc;
+#else
+    return 0;
+#endif
+}
+
+int fault_trap(pid_t pid, const siginfo_t *info, struct fault_ctx *ctx)
+{
+    siginfo_t si;
+
+    /* a seized tracee reports job control as PTRACE_EVENT_STOP; with
+     * SIGTRAP it is only telling us a stop has ended */
+    if ((info->si_status >> 8) == PTRACE_EVENT_STOP) {
+        if ((info->si_status & 0xff) == SIGTRAP) {
+            ptrace(PTRACE_CONT, pid, NULL, NULL);
+            return 1;
+        }
+        ptrace(PTRACE_LISTEN, pid, NULL, NULL);
+        return 0;
+    }
+
+    /* signal-delivery-stop: record it and deliver it as it was */
+    if (ptrace(PTRACE_GETSIGINFO, pid, NULL, &si) == 0) {
+        memset(ctx, 0, sizeof(*ctx));
+        ctx->signo = si.si_signo;
+        ctx->code = si.si_code;
+        if (sigtab_has_addr(si.si_signo, si.si_code))
+            ctx->addr = (uintptr_t)si.si_addr;
+        else if (si.si_code <= 0)
+            ctx->sender = si.si_pid;
+        ctx->ip = fault_ip(pid);
+    }
+    ptrace(PTRACE_CONT, pid, NULL, (void *)(long)(info->si_status & 0xff));
+    return 1;
+}
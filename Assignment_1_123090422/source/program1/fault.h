@@ -0,0 +1,35 @@
+#ifndef FAULT_H
+#define FAULT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <signal.h>
+
+/*
+ * Fault context of signalled children (--fault-context).
+ *
+ * Children are held before exec until the supervisor has attached with
+ * PTRACE_SEIZE, so even a crash in the first instruction is seen. A seized
+ * tracee only stops when a signal is about to be delivered: the supervisor
+ * copies the siginfo and the instruction pointer and resumes it with the
+ * same signal, so the child's fate is unchanged and children that are not
+ * signalled never stop at all. Job control stops are left in place with
+ * PTRACE_LISTEN and reported like any other stop.
+ */
+
+struct fault_ctx {
+    int signo;          /* last signal delivered, 0 if none */
+    int code;           /* its si_code */
+    pid_t sender;       /* si_pid of signals sent with kill() and friends */
+    uint64_t addr;      /* si_addr of hardware faults */
+    uint64_t ip;        /* instruction pointer at delivery, 0 if unknown */
+};
+
+/* trace a held child; the caller releases it afterwards */
+int fault_attach(pid_t pid);
+
+/* a ptrace stop of pid; returns 1 when it was a signal delivery, which is
+ * recorded in ctx and passed on, 0 for a job control stop */
+int fault_trap(pid_t pid, const siginfo_t *info, struct fault_ctx *ctx);
+
+#endif
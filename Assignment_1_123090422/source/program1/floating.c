@@ -4,11 +4,18 @@
 #include <stdlib.h>
 
 int main(int argc,char* argv[]){
+#ifdef FAST
+	static const char msg[] = "This is the SIGFPE program\n";
+
+	write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+	raise(SIGFPE);
+#else
 	printf("------------CHILD PROCESS START------------\n");
 	printf("This is the SIGFPE program\n\n");
 	raise(SIGFPE);
 	sleep(5);
 	printf("------------CHILD PROCESS END------------\n");
+#endif
 
 	return 0;
 }
@@ -4,11 +4,18 @@
 #include <stdlib.h>
 
 int main(int argc,char* argv[]){
+#ifdef FAST
+	static const char msg[] = "This is the SIGHUP program\n";
+
+	write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+	raise(SIGHUP);
+#else
 	printf("------------CHILD PROCESS START------------\n");
 	printf("This is the SIGHUP program\n\n");
 	raise(SIGHUP);
 	sleep(5);
 	printf("------------CHILD PROCESS END------------\n");
+#endif
 
 	return 0;
 }
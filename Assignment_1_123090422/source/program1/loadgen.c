@@ -0,0 +1,222 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+
+/*
+ * Load generator for program1 --daemon: keeps up to -c launches in flight
+ * until -n have completed, then reports the sustained launch rate and the
+ * request-to-result latency distribution. Launches the daemon turned away
+ * with EAGAIN are resent and their latency counts from the first attempt.
+ */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s -s SOCKET [-n count] [-c in_flight] "
+            "[-t wall_ms] [-e VAR=VALUE]... program [args...]\n", prog);
+}
+
+/* pack path, argv and envp behind the header */
+static size_t build_req(char *buf, char **argv, int argc, char **envp,
+                        int envc, uint32_t wall_ms)
+{
+    struct daemon_req *req = (struct daemon_req *)buf;
+    size_t len = sizeof(*req);
+    int i;
+
+    memset(req, 0, sizeof(*req));
+    req->version = DAEMON_PROTO_VERSION;
+    req->argc = argc;
+    req->envc = envc;
+    req->wall_ms = wall_ms;
+    for (i = -1; i < argc + envc; i++) {
+        const char *s = i < 0 ? argv[0] : i < argc ? argv[i] :
+                        envp[i - argc];
+        size_t n = strlen(s) + 1;
+
+        if (len + n > DAEMON_MSG_MAX) {
+            fprintf(stderr, "request too large\n");
+            exit(1);
+        }
+        memcpy(buf + len, s, n);
+        len += n;
+    }
+    req->size = len;
+    return len;
+}
+
+int main(int argc, char *argv[])
+{
+    static uint64_t buf[DAEMON_MSG_MAX / sizeof(uint64_t)];
+    struct daemon_req *req = (struct daemon_req *)buf;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    const char *sock = NULL;
+    char **envp = NULL;
+    int envc = 0, count = 10000, window = 64, opt, fd;
+    uint32_t wall_ms = 0;
+    uint64_t *sent, *lat, *retry, start, elapsed;
+    uint64_t *per_sec, nsec;
+    int next = 0, done = 0, inflight = 0, nretry = 0;
+    int failed = 0, nonzero = 0, rejected = 0, i;
+    size_t len;
+
+    while ((opt = getopt(argc, argv, "+s:n:c:t:e:h")) != -1) {
+        switch (opt) {
+        case 's':
+            sock = optarg;
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'c':
+            window = atoi(optarg);
+            break;
+        case 't':
+            wall_ms = atoi(optarg);
+            break;
+        case 'e':
+            envp = realloc(envp, (envc + 1) * sizeof(*envp));
+            if (!envp) {
+                perror("realloc");
+                return 1;
+            }
+            envp[envc++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!sock || optind >= argc || count <= 0 || window <= 0 ||
+        strlen(sock) >= sizeof(addr.sun_path)) {
+        usage(argv[0]);
+        return 1;
+    }
+    len = build_req((char *)buf, argv + optind, argc - optind, envp, envc,
+                    wall_ms);
+
+    strcpy(addr.sun_path, sock);
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror(sock);
+        return 1;
+    }
+
+    sent = calloc(count, sizeof(*sent));
+    lat = calloc(count, sizeof(*lat));
+    retry = calloc(count, sizeof(*retry));
+    per_sec = calloc(3600, sizeof(*per_sec));
+    if (!sent || !lat || !retry || !per_sec) {
+        perror("calloc");
+        return 1;
+    }
+
+    start = now_ns();
+    while (done < count) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+        while (inflight < window && (nretry > 0 || next < count)) {
+            int resend = nretry > 0;
+
+            req->tag = resend ? retry[nretry - 1] : (uint64_t)next;
+            if (send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+                if (errno != EAGAIN) {
+                    perror("send");
+                    return 1;
+                }
+                pfd.events |= POLLOUT;
+                break;
+            }
+            if (resend)
+                nretry--;
+            else
+                sent[next++] = now_ns();
+            inflight++;
+        }
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            perror("poll");
+            return 1;
+        }
+        if (pfd.revents & (POLLERR | POLLHUP)) {
+            fprintf(stderr, "daemon closed the connection after %d results\n",
+                    done);
+            return 1;
+        }
+        for (;;) {
+            struct daemon_result res;
+            ssize_t n = recv(fd, &res, sizeof(res), MSG_DONTWAIT);
+            uint64_t now;
+
+            if (n < 0 && errno == EAGAIN)
+                break;
+            if (n != sizeof(res) || res.tag >= (uint64_t)count) {
+                fprintf(stderr, "bad result from daemon\n");
+                return 1;
+            }
+            inflight--;
+            if (res.err == EAGAIN) {
+                rejected++;
+                retry[nretry++] = res.tag;
+                continue;
+            }
+            now = now_ns();
+            lat[done++] = now - sent[res.tag];
+            nsec = (now - start) / 1000000000ull;
+            if (nsec < 3600)
+                per_sec[nsec]++;
+            if (res.err)
+                failed++;
+            else if (res.rec.outcome != OUTCOME_EXITED ||
+                     res.rec.exit_code != 0)
+                nonzero++;
+        }
+    }
+    elapsed = now_ns() - start;
+    close(fd);
+
+    qsort(lat, count, sizeof(*lat), cmp_u64);
+    printf("%d launches in %.3fs: %.0f launches/s, %d failed, "
+           "%d not exit 0, %d rejected and resent\n",
+           count, elapsed / 1e9, count / (elapsed / 1e9), failed, nonzero,
+           rejected);
+    /* the last second is partial, so only whole seconds count */
+    nsec = elapsed / 1000000000ull;
+    if (nsec > 0 && nsec <= 3600) {
+        uint64_t lo = per_sec[0];
+
+        for (i = 1; i < (int)nsec; i++)
+            if (per_sec[i] < lo)
+                lo = per_sec[i];
+        printf("slowest whole second: %llu launches\n",
+               (unsigned long long)lo);
+    }
+    printf("latency: p50 %.1fus p90 %.1fus p99 %.1fus p99.9 %.1fus "
+           "max %.1fus\n",
+           lat[count / 2] / 1e3, lat[(size_t)(count * 0.9)] / 1e3,
+           lat[(size_t)(count * 0.99)] / 1e3,
+           lat[(size_t)(count * 0.999)] / 1e3, lat[count - 1] / 1e3);
+    return failed ? 1 : 0;
+}
@@ -1,8 +1,15 @@
 #include <stdio.h>
+#include <unistd.h>
 
 int main(int argc,char* argv[]){
+#ifdef FAST
+	static const char msg[] = "This is the normal program\n";
+
+	write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+#else
 	printf("------------CHILD PROCESS START------------\n");
 	printf("This is the normal program\n\n");
 	printf("------------CHILD PROCESS END------------\n");
+#endif
 	return 0;
 }
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -5,37 +6,670 @@
 #include <sys/types.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
+#include <libgen.h>
+#include <stddef.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 
-#include <signal.h>
+#include "reaper.h"
+#include "spawn.h"
+#include "report.h"
+#include "capture.h"
+#include "cgroup.h"
+#include "daemon.h"
+#include "fault.h"
+#include "../common/sigtab.h"
 
 const char* sig_name(int sig) {
-    switch(sig) {
-        case SIGABRT: return "SIGABRT";
-        case SIGFPE:  return "SIGFPE";
-        case SIGILL:  return "SIGILL";
-        case SIGINT:  return "SIGINT";
-        case SIGKILL: return "SIGKILL";
-        case SIGQUIT: return "SIGQUIT";
-        case SIGSEGV: return "SIGSEGV";
-        case SIGTERM: return "SIGTERM";
-        case SIGTRAP: return "SIGTRAP";
-        case SIGSTOP: return "SIGSTOP";
-        case SIGHUP:  return "SIGHUP";
-        case SIGALRM: return "SIGALRM";
-        case SIGBUS:  return "SIGBUS";
-        case SIGPIPE: return "SIGPIPE";
-        default: return strsignal(sig);;
+    return sigtab_name(sig);
+}
+
+/* lifecycle of a supervised child; a continued child is running again */
+enum job_state {
+    JOB_PENDING,
+    JOB_RUNNING,
+    JOB_STOPPED,
+    JOB_EXITED,
+    JOB_NR_STATES,
+};
+
+/* what to do with a child that reports a stop */
+enum stop_policy {
+    STOP_KILL,      /* report the stop, then SIGKILL and reap it */
+    STOP_RESUME,    /* send SIGCONT and keep supervising */
+    STOP_HOLD,      /* leave it stopped until someone else resumes it */
+};
+
+/* batch mode: one entry per test program */
+struct job {
+    char **argv;        /* NULL-terminated, argv[0] is the program path */
+    char *name;         /* basename of argv[0], used as the output tag */
+    pid_t pid;
+    int status;
+    struct rusage ru;
+    struct timespec start;
+    struct timespec end;
+    struct timespec start_real;
+    int limit_hit;          /* enum report_limit */
+    clockid_t cpu_clock;
+    struct reaper_watch *wall_timer;
+    struct reaper_watch *cpu_timer;
+    struct reaper_watch *kill_timer;
+    enum job_state state;
+    struct timespec state_since;
+    uint64_t state_ns[JOB_NR_STATES];
+    int nstops;
+    int nconts;
+    struct cgroup_leaf cg;      /* per child leaf, fd -1 if none */
+    struct cgroup_stats cg_stats;
+    struct fault_ctx fault;     /* --fault-context */
+};
+
+struct batch {
+    struct job *jobs;
+    int njobs;
+    int cap;
+    int max_running;    /* -j K, 0 means no limit */
+    int running;
+    int reported;
+    struct rusage total;    /* summed usage, ru_maxrss holds the peak */
+    enum spawn_mode spawn_mode;
+    struct reaper reaper;
+    struct report_out out;
+    int capture_on;
+    struct capture capture;
+    long wall_limit_ms;     /* 0 means no limit */
+    long cpu_limit_ms;
+    long grace_ms;          /* SIGTERM to SIGKILL delay */
+    enum stop_policy stop_policy;
+    const char *cg_parent;      /* --cgroup, NULL when not sandboxing */
+    int cg_per_batch;
+    struct cgroup_limits cg_limits;
+    struct cgroup_leaf batch_cg;
+    struct cgroup_pending cg_pending;   /* busy leaves, retried by cg_timer */
+    struct reaper_watch *cg_timer;
+    int fault_context;          /* trace children for their fault context */
+};
+
+/* how often CPU time limits are checked; process CPU clocks cannot drive
+ * a timerfd directly */
+#define CPU_POLL_MS 50
+#define DEFAULT_GRACE_MS 2000
+/* retry interval for leaves that were still busy when their child went */
+#define CGROUP_RETRY_MS 5
+
+static double tv_sec(const struct timeval *tv)
+{
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static double ts_diff(const struct timespec *a, const struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/* tag is prepended to the line, e.g. "[abort] " in batch mode */
+static void print_rusage(const char *tag, const struct rusage *ru)
+{
+    printf("%sCPU time: user %.3fs sys %.3fs, max RSS %ld KB, "
+           "page faults %ld major / %ld minor, "
+           "context switches %ld voluntary / %ld involuntary\n",
+           tag, tv_sec(&ru->ru_utime), tv_sec(&ru->ru_stime), ru->ru_maxrss,
+           ru->ru_majflt, ru->ru_minflt, ru->ru_nvcsw, ru->ru_nivcsw);
+}
+
+static void rusage_add(struct rusage *sum, const struct rusage *ru)
+{
+    timeradd(&sum->ru_utime, &ru->ru_utime, &sum->ru_utime);
+    timeradd(&sum->ru_stime, &ru->ru_stime, &sum->ru_stime);
+    if (ru->ru_maxrss > sum->ru_maxrss)
+        sum->ru_maxrss = ru->ru_maxrss;
+    sum->ru_majflt += ru->ru_majflt;
+    sum->ru_minflt += ru->ru_minflt;
+    sum->ru_nvcsw += ru->ru_nvcsw;
+    sum->ru_nivcsw += ru->ru_nivcsw;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s <test_program_name>\n", prog);
+    printf("       %s [-j K] [-f manifest] [--spawn=MODE] [--format=FORMAT]\n"
+           "           [--capture=DIR|-] [--timeout=SEC] [--cpu-limit=SEC]\n"
+           "           [--grace=SEC] [--on-stop=POLICY] [--cgroup=DIR]\n"
+           "           [--cgroup-scope=child|batch] [--memory-max=BYTES]\n"
+           "           [--cpu-max=CPUS] [--pids-max=N] [--fault-context]\n"
+           "           <test_program_name>...\n",
+           prog);
+    printf("       MODE is fork (default), vfork, posix_spawn or clone3\n");
+    printf("       FORMAT is text (default), jsonl or binary\n");
+    printf("       --capture logs child output to DIR/<name>.<pid>.log, "
+           "or framed to stdout with -\n");
+    printf("       --timeout=SEC and --cpu-limit=SEC stop a child with SIGTERM,\n"
+           "       then SIGKILL after --grace=SEC (default %.1f, 0 kills at once)\n",
+           DEFAULT_GRACE_MS / 1000.0);
+    printf("       POLICY for stopped children is kill (default), resume or hold\n");
+    printf("       --cgroup=DIR runs each child (or, with --cgroup-scope=batch,\n"
+           "       the whole batch) in a cgroup v2 leaf below DIR, limited by\n"
+           "       --memory-max=BYTES[KMG], --cpu-max=CPUS and --pids-max=N\n");
+    printf("       --fault-context traces children with ptrace to record the\n"
+           "       si_code, fault address and instruction pointer of the signal\n"
+           "       that ended them (implies --spawn=fork)\n");
+    printf("       %s --daemon=SOCKET [--spawn=MODE] serves launch requests\n"
+           "       on a Unix socket until SIGINT or SIGTERM (see loadgen)\n",
+           prog);
+}
+
+static void batch_add(struct batch *b, char **argv)
+{
+    struct job *job;
+
+    if (b->njobs == b->cap) {
+        b->cap = b->cap ? b->cap * 2 : 16;
+        b->jobs = realloc(b->jobs, b->cap * sizeof(*b->jobs));
+        if (!b->jobs) {
+            perror("realloc");
+            exit(1);
+        }
     }
+    job = &b->jobs[b->njobs++];
+    memset(job, 0, sizeof(*job));
+    job->argv = argv;
+    job->name = strdup(argv[0]);
+    job->name = basename(job->name);
+    job->pid = -1;
 }
 
-int main(int argc, char *argv[]){
-	pid_t pid;
-	int status;
+/* add a single program path without extra arguments */
+static void batch_add_path(struct batch *b, const char *path)
+{
+    char **argv = calloc(2, sizeof(*argv));
 
-    if (argc != 2) {
-        printf("Usage: %s <test_program_name>\n", argv[0]);
+    if (!argv) {
+        perror("calloc");
         exit(1);
     }
+    argv[0] = strdup(path);
+    batch_add(b, argv);
+}
+
+/* manifest format: one program per line, optionally followed by its
+ * whitespace separated arguments; blank lines and '#' comments are skipped */
+static int batch_load_manifest(struct batch *b, const char *file)
+{
+    FILE *fp = fopen(file, "r");
+    char line[4096];
+
+    if (!fp) {
+        perror(file);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        char *save = NULL, *tok;
+        char **argv = NULL;
+        int argc = 0;
+
+        line[strcspn(line, "#\n")] = '\0';
+        for (tok = strtok_r(line, " \t", &save); tok;
+             tok = strtok_r(NULL, " \t", &save)) {
+            argv = realloc(argv, (argc + 2) * sizeof(*argv));
+            if (!argv) {
+                perror("realloc");
+                exit(1);
+            }
+            argv[argc++] = strdup(tok);
+            argv[argc] = NULL;
+        }
+        if (argc)
+            batch_add(b, argv);
+    }
+    fclose(fp);
+    return 0;
+}
+
+static uint64_t ts_ns(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+static void job_record(const struct job *job, struct report_record *rec)
+{
+    report_fill(rec, job->pid, job->status, &job->ru);
+    /* status still says how it died, the outcome says why */
+    if (job->limit_hit && job->state == JOB_EXITED) {
+        rec->outcome = OUTCOME_TIMEOUT;
+        rec->limit = job->limit_hit;
+    }
+    snprintf(rec->program, sizeof(rec->program), "%s", job->name);
+    rec->start_ns = ts_ns(&job->start_real);
+    rec->wall_ns = ts_ns(&job->end) - ts_ns(&job->start);
+    rec->running_ns = job->state_ns[JOB_RUNNING];
+    rec->stopped_ns = job->state_ns[JOB_STOPPED];
+    rec->nstops = job->nstops;
+    rec->nconts = job->nconts;
+    rec->cg_memory_peak = job->cg_stats.memory_peak;
+    rec->cg_usage_us = job->cg_stats.usage_usec;
+    rec->cg_throttled_us = job->cg_stats.throttled_usec;
+    rec->cg_nr_throttled = job->cg_stats.nr_throttled;
+    /* only the context of the signal the record is about */
+    if (job->fault.signo && job->fault.signo == rec->signo) {
+        rec->fault_signo = job->fault.signo;
+        rec->fault_code = job->fault.code;
+        rec->fault_sender = job->fault.sender;
+        rec->fault_addr = job->fault.addr;
+        rec->fault_ip = job->fault.ip;
+    }
+}
+
+static void print_cgroup_stats(const char *tag, const struct cgroup_stats *st)
+{
+    printf("%scgroup: ", tag);
+    if (st->memory_peak >= 0)
+        printf("memory.peak %lld KB, ", (long long)st->memory_peak / 1024);
+    printf("cpu usage %.3fs (user %.3fs sys %.3fs), "
+           "throttled %.3fs in %lld periods\n",
+           st->usage_usec / 1e6, st->user_usec / 1e6, st->system_usec / 1e6,
+           st->throttled_usec / 1e6, (long long)st->nr_throttled);
+}
+
+static void print_fault(const struct job *job)
+{
+    const struct fault_ctx *f = &job->fault;
+
+    printf("[%s] fault context: %s %s", job->name, sig_name(f->signo),
+           sigtab_code_name(f->signo, f->code));
+    if (sigtab_has_addr(f->signo, f->code))
+        printf(" at %#llx", (unsigned long long)f->addr);
+    else if (f->sender)
+        printf(" from pid %d", (int)f->sender);
+    printf(", ip %#llx\n", (unsigned long long)f->ip);
+}
+
+static void batch_report(struct batch *b, const struct job *job)
+{
+    int status = job->status;
+
+    /* our lines must not land inside a parked capture frame */
+    capture_sync(&b->capture, &b->reaper);
+    if (b->out.format != REPORT_TEXT) {
+        struct report_record rec;
+
+        job_record(job, &rec);
+        report_emit(&b->out, &rec);
+        return;
+    }
+
+    printf("[%s] Parent process receives SIGCHLD signal\n", job->name);
+    if (job->limit_hit && job->state == JOB_EXITED)
+        printf("[%s] child process exceeded its %s time limit\n",
+               job->name, report_limit_name(job->limit_hit));
+    if (WIFEXITED(status)) {
+        printf("[%s] Normal termination with EXIT STATUS = %d\n",
+               job->name, WEXITSTATUS(status));
+    }
+    else if (WIFSIGNALED(status)) {
+        printf("[%s] child process get %s signal\n",
+               job->name, sig_name(WTERMSIG(status)));
+        if (job->fault.signo == WTERMSIG(status))
+            print_fault(job);
+    }
+    else if (WIFSTOPPED(status)) {
+        printf("[%s] child process get %s signal\n",
+               job->name, sig_name(WSTOPSIG(status)));
+    }
+    else if (WIFCONTINUED(status)) {
+        printf("[%s] child process continued by SIGCONT\n", job->name);
+    }
+    else {
+        printf("[%s] Child process terminated abnormally\n", job->name);
+    }
+    if (job->state != JOB_EXITED) {
+        fflush(stdout);
+        return;
+    }
+
+    char tag[256];
+    snprintf(tag, sizeof(tag), "[%s] ", job->name);
+    printf("%sWall time: %.3fs (running %.3fs, stopped %.3fs, "
+           "%d stops, %d continues)\n", tag,
+           ts_diff(&job->start, &job->end),
+           job->state_ns[JOB_RUNNING] / 1e9, job->state_ns[JOB_STOPPED] / 1e9,
+           job->nstops, job->nconts);
+    print_rusage(tag, &job->ru);
+    if (b->cg_parent && !b->cg_per_batch)
+        print_cgroup_stats(tag, &job->cg_stats);
+    fflush(stdout);
+}
+
+static void batch_cg_retry(struct reaper *r, struct reaper_watch *w,
+                           uint32_t events)
+{
+    struct batch *b = w->data;
+
+    if (cgroup_pending_retry(&b->cg_pending) == 0) {
+        reaper_remove(r, w);
+        b->cg_timer = NULL;
+    }
+}
+
+/* remove the job's leaf without blocking the loop on leftovers */
+static void batch_cg_release(struct batch *b, struct job *job)
+{
+    cgroup_leaf_destroy(&job->cg, &b->cg_pending);
+    if (b->cg_pending.n > 0 && !b->cg_timer)
+        b->cg_timer = reaper_add_timer(&b->reaper, CGROUP_RETRY_MS,
+                                       CGROUP_RETRY_MS, batch_cg_retry, b);
+}
+
+static int batch_launch(struct batch *b, struct job *job)
+{
+    struct spawn_opts opts;
+    struct capture_child cc;
+    int hold[2] = { -1, -1 };
+
+    spawn_opts_init(&opts);
+    opts.mask = &b->reaper.oldmask;
+    job->cg.fd = -1;
+    if (b->cg_parent && b->cg_per_batch) {
+        opts.cgroup_fd = b->batch_cg.fd;
+    } else if (b->cg_parent) {
+        char leaf[256];
+
+        snprintf(leaf, sizeof(leaf), "%s.%d.%d", job->name, getpid(),
+                 (int)(job - b->jobs));
+        if (cgroup_leaf_create(&job->cg, b->cg_parent, leaf,
+                               &b->cg_limits) < 0)
+            return -1;
+        opts.cgroup_fd = job->cg.fd;
+    }
+    if (b->capture_on) {
+        if (capture_prepare(&cc) < 0) {
+            perror("pipe");
+            batch_cg_release(b, job);
+            return -1;
+        }
+        memcpy(opts.stdio, cc.stdio, sizeof(opts.stdio));
+    }
+    if (b->fault_context) {
+        if (pipe2(hold, O_CLOEXEC) < 0) {
+            perror("pipe");
+            batch_cg_release(b, job);
+            return -1;
+        }
+        opts.hold_fd = hold[0];
+    }
+
+    /* flush before spawning so buffered output is not duplicated by fork */
+    capture_sync(&b->capture, &b->reaper);
+    fflush(stdout);
+    clock_gettime(CLOCK_REALTIME, &job->start_real);
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+    job->state_since = job->start;
+    job->pid = spawn_child(b->spawn_mode, job->argv, &opts);
+    if (b->fault_context) {
+        /* attach while the child waits, then let it exec; with no child
+         * the read end is gone and a write would raise SIGPIPE */
+        if (job->pid > 0) {
+            if (fault_attach(job->pid) < 0)
+                fprintf(stderr, "[%s] PTRACE_SEIZE failed: %s\n",
+                        job->name, strerror(errno));
+            if (write(hold[1], "", 1) < 0)
+                perror("hold");
+        }
+        close(hold[0]);
+        close(hold[1]);
+    }
+    if (b->capture_on)
+        capture_attach(&b->capture, &b->reaper, &cc, job->name, job->pid);
+    if (job->pid < 0) {
+        fprintf(stderr, "[%s] %s failed: %s\n", job->name,
+                spawn_mode_name(b->spawn_mode), strerror(errno));
+        batch_cg_release(b, job);
+        return -1;
+    }
+    if (b->out.format != REPORT_TEXT)
+        return 0;
+    /* printed by the parent so every spawn backend reports the same way */
+    printf("[%s] I'm the Child Process, my pid = %d\n", job->name, job->pid);
+    printf("[%s] Child process start to execute test program:\n", job->name);
+    return 0;
+}
+
+#define container_of_batch(r) \
+    ((struct batch *)((char *)(r) - offsetof(struct batch, reaper)))
+
+static void job_cancel_timers(struct reaper *r, struct job *job)
+{
+    struct reaper_watch **timers[] = {
+        &job->wall_timer, &job->cpu_timer, &job->kill_timer
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(timers) / sizeof(timers[0]); i++) {
+        if (*timers[i]) {
+            reaper_remove(r, *timers[i]);
+            *timers[i] = NULL;
+        }
+    }
+}
+
+static void job_kill_expired(struct reaper *r, struct reaper_watch *w,
+                             uint32_t events)
+{
+    struct job *job = w->data;
+
+    job->kill_timer = NULL;
+    kill(job->pid, SIGKILL);
+}
+
+/* SIGTERM first, SIGKILL once the grace period has passed */
+static void job_escalate(struct reaper *r, struct job *job, int limit)
+{
+    struct batch *b = container_of_batch(r);
+
+    if (job->limit_hit)
+        return;
+    job->limit_hit = limit;
+    if (job->wall_timer) {
+        reaper_remove(r, job->wall_timer);
+        job->wall_timer = NULL;
+    }
+    if (job->cpu_timer) {
+        reaper_remove(r, job->cpu_timer);
+        job->cpu_timer = NULL;
+    }
+    if (b->grace_ms > 0) {
+        kill(job->pid, SIGTERM);
+        job->kill_timer = reaper_add_timer(r, b->grace_ms, 0,
+                                           job_kill_expired, job);
+        if (job->kill_timer)
+            return;
+    }
+    kill(job->pid, SIGKILL);
+}
+
+static void job_wall_expired(struct reaper *r, struct reaper_watch *w,
+                             uint32_t events)
+{
+    struct job *job = w->data;
+
+    job->wall_timer = NULL;
+    job_escalate(r, job, LIMIT_WALL);
+}
+
+static void job_cpu_check(struct reaper *r, struct reaper_watch *w,
+                          uint32_t events)
+{
+    struct batch *b = container_of_batch(r);
+    struct job *job = w->data;
+    struct timespec ts;
+
+    if (clock_gettime(job->cpu_clock, &ts) < 0)
+        return;
+    if (ts.tv_sec * 1000 + ts.tv_nsec / 1000000 >= b->cpu_limit_ms)
+        job_escalate(r, job, LIMIT_CPU);
+}
+
+static void job_arm_limits(struct batch *b, struct job *job)
+{
+    if (b->wall_limit_ms > 0)
+        job->wall_timer = reaper_add_timer(&b->reaper, b->wall_limit_ms, 0,
+                                           job_wall_expired, job);
+    if (b->cpu_limit_ms > 0 &&
+        clock_getcpuclockid(job->pid, &job->cpu_clock) == 0)
+        job->cpu_timer = reaper_add_timer(&b->reaper, CPU_POLL_MS,
+                                          CPU_POLL_MS, job_cpu_check, job);
+}
+
+/* account the time spent in the old state and enter the new one */
+static void job_set_state(struct job *job, enum job_state state,
+                          const struct timespec *now)
+{
+    job->state_ns[job->state] += ts_ns(now) - ts_ns(&job->state_since);
+    job->state = state;
+    job->state_since = *now;
+}
+
+static int batch_child_trap(struct reaper *r, struct reaper_watch *w,
+                            const siginfo_t *info)
+{
+    struct job *job = w->data;
+
+    return fault_trap(job->pid, info, &job->fault);
+}
+
+static void batch_child_event(struct reaper *r, struct reaper_watch *w,
+                              int status, const struct rusage *ru)
+{
+    struct batch *b = container_of_batch(r);
+    struct job *job = w->data;
+
+    clock_gettime(CLOCK_MONOTONIC, &job->end);
+    job->status = status;
+    job->ru = *ru;
+
+    if (WIFSTOPPED(status)) {
+        job_set_state(job, JOB_STOPPED, &job->end);
+        job->nstops++;
+        batch_report(b, job);
+        /* limit timers keep running, so a held child still times out */
+        if (b->stop_policy == STOP_RESUME)
+            kill(job->pid, SIGCONT);
+        else if (b->stop_policy == STOP_KILL)
+            kill(job->pid, SIGKILL);
+        return;
+    }
+    if (WIFCONTINUED(status)) {
+        job_set_state(job, JOB_RUNNING, &job->end);
+        job->nconts++;
+        batch_report(b, job);
+        return;
+    }
+
+    job_set_state(job, JOB_EXITED, &job->end);
+    job_cancel_timers(r, job);
+    /* read the numbers before the leaf goes away */
+    cgroup_leaf_stats(&job->cg, &job->cg_stats);
+    batch_cg_release(b, job);
+    b->running--;
+    b->reported++;
+    rusage_add(&b->total, ru);
+    batch_report(b, job);
+}
+
+/* keep up to max_running children alive and reap them in completion order */
+static int run_batch(struct batch *b)
+{
+    int next = 0, failed = 0;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (reaper_init(&b->reaper) < 0) {
+        perror("reaper_init");
+        return 1;
+    }
+    b->batch_cg.fd = -1;
+    if (b->cg_parent) {
+        /* missing controllers only cost the matching limits */
+        cgroup_prepare_parent(b->cg_parent);
+        if (b->cg_per_batch) {
+            char leaf[64];
+
+            snprintf(leaf, sizeof(leaf), "batch.%d", getpid());
+            if (cgroup_leaf_create(&b->batch_cg, b->cg_parent, leaf,
+                                   &b->cg_limits) < 0)
+                return 1;
+        }
+    }
+
+    if (b->out.format == REPORT_TEXT) {
+        printf("Process start to fork %d programs\n", b->njobs);
+        printf("I'm the Parent Process, my pid = %d\n", getpid());
+    }
+
+    while (next < b->njobs || b->running > 0 || b->capture.open_streams > 0) {
+        while (next < b->njobs &&
+               (b->max_running <= 0 || b->running < b->max_running)) {
+            struct job *job = &b->jobs[next++];
+            struct reaper_watch *w;
+
+            if (batch_launch(b, job) < 0) {
+                failed++;
+                continue;
+            }
+            w = reaper_add_child(&b->reaper, job->pid, batch_child_event, job);
+            if (!w) {
+                perror("reaper_add_child");
+                kill(job->pid, SIGKILL);
+                waitpid(job->pid, NULL, 0);
+                batch_cg_release(b, job);
+                failed++;
+                continue;
+            }
+            if (b->fault_context)
+                w->trap = batch_child_trap;
+            job_set_state(job, JOB_RUNNING, &job->start);
+            job_arm_limits(b, job);
+            b->running++;
+        }
+        if (b->running == 0 && b->capture.open_streams == 0)
+            continue;
+        if (reaper_run_once(&b->reaper, -1) < 0) {
+            perror("epoll_wait");
+            return 1;
+        }
+        /* one write per dispatch round, not per record */
+        if (b->out.len > 0) {
+            capture_sync(&b->capture, &b->reaper);
+            report_flush(&b->out);
+        }
+    }
+    reaper_destroy(&b->reaper);
+    cgroup_pending_drain(&b->cg_pending);
+
+    struct cgroup_stats cg_stats;
+    cgroup_leaf_stats(&b->batch_cg, &cg_stats);
+    cgroup_leaf_destroy(&b->batch_cg, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (b->out.format != REPORT_TEXT)
+        return failed ? 1 : 0;
+    printf("Summary: %d programs reported, %d failed to start, "
+           "wall time %.3fs\n", b->reported, failed, ts_diff(&start, &end));
+    print_rusage("Summary: ", &b->total);
+    if (b->cg_parent && b->cg_per_batch)
+        print_cgroup_stats("Summary: ", &cg_stats);
+    return failed ? 1 : 0;
+}
+
+static int run_single(const char *path)
+{
+	pid_t pid;
+	int status;
+	struct rusage ru;
 
 	printf("Process start to fork\n");
 
@@ -54,7 +688,7 @@ else if (pid == 0) {
         printf("I'm the Child Process, my pid = %d\n", getpid());
         printf("Child process start to execute test program:\n");
         /* execute test program */
-        execl(argv[1], argv[1], NULL);
+        execl(path, path, NULL);
         
         /* if execl returns, it means it failed */
         perror("execl failed");
@@ -66,7 +700,7 @@ else if (pid == 0) {
         printf("I'm the Parent Process, my pid = %d\n", getpid());
         
         /* wait for child process terminates */
-        waitpid(pid, &status, WUNTRACED);
+        wait4(pid, &status, WUNTRACED, &ru);
         
         printf("Parent process receives SIGCHLD signal\n");
         
@@ -81,11 +715,177 @@ else if (pid == 0) {
         else if (WIFSTOPPED(status)) {
             int sig = WSTOPSIG(status);
             printf("child process get %s signal\n", sig_name(sig));
+            /* do not leave a stopped orphan behind */
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
         }
         else {
             printf("Child process terminated abnormally\n");
         }
+        print_rusage("", &ru);
     }
     
     return 0;
-}
\ No newline at end of file
+}
+
+/* seconds, fractions allowed, as milliseconds */
+static long parse_ms(const char *arg)
+{
+    char *end;
+    double sec = strtod(arg, &end);
+
+    if (end == arg || *end != '\0' || sec < 0) {
+        fprintf(stderr, "invalid time: %s\n", arg);
+        exit(1);
+    }
+    return (long)(sec * 1000);
+}
+
+/* bytes with an optional K, M or G suffix */
+static long long parse_size(const char *arg)
+{
+    char *end;
+    long long val = strtoll(arg, &end, 10);
+
+    switch (*end) {
+    case 'G': case 'g':
+        val <<= 10;
+        /* fall through */
+    case 'M': case 'm':
+        val <<= 10;
+        /* fall through */
+    case 'K': case 'k':
+        val <<= 10;
+        end++;
+        break;
+    }
+    if (end == arg || *end != '\0' || val <= 0) {
+        fprintf(stderr, "invalid size: %s\n", arg);
+        exit(1);
+    }
+    return val;
+}
+
+int main(int argc, char *argv[]){
+    struct batch b = { 0 };
+    const char *daemon_sock = NULL;
+    int opt;
+
+    if (argc == 2 && argv[1][0] != '-')
+        return run_single(argv[1]);
+
+    static const struct option long_opts[] = {
+        { "spawn", required_argument, NULL, 'S' },
+        { "format", required_argument, NULL, 'F' },
+        { "capture", required_argument, NULL, 'C' },
+        { "timeout", required_argument, NULL, 'T' },
+        { "cpu-limit", required_argument, NULL, 'U' },
+        { "grace", required_argument, NULL, 'G' },
+        { "on-stop", required_argument, NULL, 'P' },
+        { "cgroup", required_argument, NULL, 'c' },
+        { "cgroup-scope", required_argument, NULL, 'o' },
+        { "memory-max", required_argument, NULL, 'm' },
+        { "cpu-max", required_argument, NULL, 'u' },
+        { "pids-max", required_argument, NULL, 'p' },
+        { "daemon", required_argument, NULL, 'D' },
+        { "fault-context", no_argument, NULL, 'X' },
+        { "help",  no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    report_init(&b.out, REPORT_TEXT, STDOUT_FILENO);
+    capture_init(&b.capture, NULL, STDOUT_FILENO);
+    b.grace_ms = DEFAULT_GRACE_MS;
+    while ((opt = getopt_long(argc, argv, "j:f:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'S':
+            if (spawn_parse_mode(optarg, &b.spawn_mode) < 0) {
+                fprintf(stderr, "unknown spawn mode: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'T':
+            b.wall_limit_ms = parse_ms(optarg);
+            break;
+        case 'U':
+            b.cpu_limit_ms = parse_ms(optarg);
+            break;
+        case 'G':
+            b.grace_ms = parse_ms(optarg);
+            break;
+        case 'D':
+            daemon_sock = optarg;
+            break;
+        case 'c':
+            b.cg_parent = optarg;
+            break;
+        case 'o':
+            if (strcmp(optarg, "child") == 0)
+                b.cg_per_batch = 0;
+            else if (strcmp(optarg, "batch") == 0)
+                b.cg_per_batch = 1;
+            else {
+                fprintf(stderr, "unknown cgroup scope: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'm':
+            b.cg_limits.memory_max = parse_size(optarg);
+            break;
+        case 'u':
+            /* cpu.max is quota per period; express CPUs over 100ms */
+            b.cg_limits.cpu_period_us = 100000;
+            b.cg_limits.cpu_quota_us = (long)(strtod(optarg, NULL) * 100000);
+            break;
+        case 'p':
+            b.cg_limits.pids_max = atol(optarg);
+            break;
+        case 'P':
+            if (strcmp(optarg, "kill") == 0)
+                b.stop_policy = STOP_KILL;
+            else if (strcmp(optarg, "resume") == 0)
+                b.stop_policy = STOP_RESUME;
+            else if (strcmp(optarg, "hold") == 0)
+                b.stop_policy = STOP_HOLD;
+            else {
+                fprintf(stderr, "unknown stop policy: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'C':
+            b.capture_on = 1;
+            if (strcmp(optarg, "-") != 0)
+                b.capture.dir = optarg;
+            break;
+        case 'F':
+            if (report_parse_format(optarg, &b.out.format) < 0) {
+                fprintf(stderr, "unknown format: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'X':
+            b.fault_context = 1;
+            break;
+        case 'j':
+            b.max_running = atoi(optarg);
+            break;
+        case 'f':
+            if (batch_load_manifest(&b, optarg) < 0)
+                exit(1);
+            break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (daemon_sock)
+        return run_daemon(daemon_sock, b.spawn_mode);
+    for (; optind < argc; optind++)
+        batch_add_path(&b, argv[optind]);
+
+    if (b.njobs == 0) {
+        usage(argv[0]);
+        exit(1);
+    }
+    return run_batch(&b);
+}
@@ -0,0 +1,362 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+
+#include "reaper.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+#define REAPER_BUCKETS 4096
+#define REAPER_EVENTS  256
+
+static int sys_pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* rebuild a waitpid() style status word from waitid() information */
+static int info_to_status(const siginfo_t *info)
+{
+    switch (info->si_code) {
+    case CLD_EXITED:
+        return (info->si_status & 0xff) << 8;
+    case CLD_KILLED:
+        return info->si_status & 0x7f;
+    case CLD_DUMPED:
+        return (info->si_status & 0x7f) | 0x80;
+    case CLD_STOPPED:
+    case CLD_TRAPPED:
+        return ((info->si_status & 0xff) << 8) | 0x7f;
+    case CLD_CONTINUED:
+        return 0xffff;
+    default:
+        return 0;
+    }
+}
+
+/* glibc's waitid() drops the rusage argument the kernel supports */
+static int waitid_rusage(idtype_t type, id_t id, siginfo_t *info, int flags,
+                         struct rusage *ru)
+{
+    return syscall(SYS_waitid, type, id, info, flags, ru);
+}
+
+static unsigned int pid_hash(const struct reaper *r, pid_t pid)
+{
+    return ((unsigned int)pid * 2654435761u) & (r->nbuckets - 1);
+}
+
+static struct reaper_watch *hash_find(struct reaper *r, pid_t pid)
+{
+    struct reaper_watch *w;
+
+    for (w = r->buckets[pid_hash(r, pid)]; w; w = w->hnext)
+        if (w->pid == pid)
+            return w;
+    return NULL;
+}
+
+static void hash_del(struct reaper *r, struct reaper_watch *w)
+{
+    struct reaper_watch **pp = &r->buckets[pid_hash(r, w->pid)];
+
+    for (; *pp; pp = &(*pp)->hnext) {
+        if (*pp == w) {
+            *pp = w->hnext;
+            return;
+        }
+    }
+}
+
+int reaper_init(struct reaper *r)
+{
+    struct epoll_event ev;
+    sigset_t mask;
+    int fd;
+
+    memset(r, 0, sizeof(*r));
+    r->sigfd = -1;
+    r->nbuckets = REAPER_BUCKETS;
+    r->buckets = calloc(r->nbuckets, sizeof(*r->buckets));
+    if (!r->buckets)
+        return -1;
+
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epfd < 0)
+        return -1;
+
+    /* probe pidfd support on ourselves */
+    fd = sys_pidfd_open(getpid());
+    if (fd >= 0) {
+        r->use_pidfd = 1;
+        close(fd);
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, &r->oldmask) < 0)
+        return -1;
+    r->sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (r->sigfd < 0)
+        return -1;
+
+    r->sigwatch.kind = REAPER_FD;
+    r->sigwatch.fd = r->sigfd;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &r->sigwatch;
+    return epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->sigfd, &ev);
+}
+
+static void reaper_bury(struct reaper *r)
+{
+    while (r->graveyard) {
+        struct reaper_watch *w = r->graveyard;
+
+        r->graveyard = w->fnext;
+        free(w);
+    }
+}
+
+void reaper_destroy(struct reaper *r)
+{
+    unsigned int i;
+
+    for (i = 0; i < r->nbuckets; i++)
+        while (r->buckets[i])
+            reaper_remove(r, r->buckets[i]);
+    reaper_bury(r);
+    free(r->buckets);
+    if (r->sigfd >= 0)
+        close(r->sigfd);
+    if (r->epfd >= 0)
+        close(r->epfd);
+    sigprocmask(SIG_SETMASK, &r->oldmask, NULL);
+}
+
+void reaper_child_setup(const struct reaper *r)
+{
+    sigprocmask(SIG_SETMASK, &r->oldmask, NULL);
+}
+
+static struct reaper_watch *watch_new(struct reaper *r, enum reaper_kind kind,
+                                      int fd, uint32_t events, void *data)
+{
+    struct reaper_watch *w = calloc(1, sizeof(*w));
+    struct epoll_event ev;
+
+    if (!w)
+        return NULL;
+    w->kind = kind;
+    w->fd = fd;
+    w->data = data;
+    if (fd >= 0) {
+        ev.events = events;
+        ev.data.ptr = w;
+        if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            free(w);
+            return NULL;
+        }
+    }
+    return w;
+}
+
+struct reaper_watch *reaper_add_child(struct reaper *r, pid_t pid,
+                                      reaper_child_cb cb, void *data)
+{
+    struct reaper_watch *w;
+    unsigned int h;
+    int fd = -1;
+
+    if (r->use_pidfd) {
+        fd = sys_pidfd_open(pid);
+        if (fd < 0)
+            return NULL;
+    }
+    w = watch_new(r, REAPER_CHILD, fd, EPOLLIN, data);
+    if (!w) {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    w->pid = pid;
+    w->cb.child = cb;
+    h = pid_hash(r, pid);
+    w->hnext = r->buckets[h];
+    r->buckets[h] = w;
+    r->nchildren++;
+    return w;
+}
+
+struct reaper_watch *reaper_add_fd(struct reaper *r, int fd, uint32_t events,
+                                   reaper_fd_cb cb, void *data)
+{
+    struct reaper_watch *w = watch_new(r, REAPER_FD, fd, events, data);
+
+    if (w)
+        w->cb.fd = cb;
+    return w;
+}
+
+struct reaper_watch *reaper_add_timer(struct reaper *r, long ms,
+                                      long interval_ms, reaper_fd_cb cb,
+                                      void *data)
+{
+    struct itimerspec its = { 0 };
+    struct reaper_watch *w;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    /* a zero it_value would disarm the timer */
+    its.it_value.tv_sec = ms / 1000;
+    its.it_value.tv_nsec = (ms % 1000) * 1000000L + 1;
+    its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    if (timerfd_settime(fd, 0, &its, NULL) < 0) {
+        close(fd);
+        return NULL;
+    }
+    w = watch_new(r, REAPER_TIMER, fd, EPOLLIN, data);
+    if (!w) {
+        close(fd);
+        return NULL;
+    }
+    w->cb.fd = cb;
+    w->periodic = interval_ms > 0;
+    return w;
+}
+
+/* the watch is freed after the current dispatch round, so events already
+ * fetched by epoll_wait() never point at released memory */
+void reaper_remove(struct reaper *r, struct reaper_watch *w)
+{
+    if (w->dead)
+        return;
+    w->dead = 1;
+    if (w->fd >= 0) {
+        epoll_ctl(r->epfd, EPOLL_CTL_DEL, w->fd, NULL);
+        /* plain fds stay owned by the caller */
+        if (w->kind != REAPER_FD)
+            close(w->fd);
+        w->fd = -1;
+    }
+    if (w->kind == REAPER_CHILD) {
+        hash_del(r, w);
+        r->nchildren--;
+    }
+    w->fnext = r->graveyard;
+    r->graveyard = w;
+}
+
+static void dispatch_child(struct reaper *r, struct reaper_watch *w,
+                           const siginfo_t *info, const struct rusage *ru)
+{
+    int status;
+
+    if (info->si_code == CLD_TRAPPED && w->trap && w->trap(r, w, info))
+        return;
+    status = info_to_status(info);
+
+    /* exited children are already reaped, so drop the watch first */
+    if (info->si_code == CLD_EXITED || info->si_code == CLD_KILLED ||
+        info->si_code == CLD_DUMPED)
+        reaper_remove(r, w);
+    w->cb.child(r, w, status, ru);
+}
+
+/* pidfd became readable: the child has exited */
+static void handle_pidfd(struct reaper *r, struct reaper_watch *w)
+{
+    struct rusage ru;
+    siginfo_t info;
+
+    memset(&info, 0, sizeof(info));
+    if (waitid_rusage(P_PIDFD, w->fd, &info, WEXITED | WNOHANG, &ru) < 0 ||
+        info.si_pid == 0)
+        return;
+    dispatch_child(r, w, &info, &ru);
+}
+
+/* SIGCHLD arrived: collect stop/continue events, plus exits when there
+ * are no pidfds to report them */
+static void handle_sigchld(struct reaper *r)
+{
+    struct signalfd_siginfo ssi;
+    int flags = WSTOPPED | WCONTINUED | WNOHANG;
+
+    while (read(r->sigfd, &ssi, sizeof(ssi)) == sizeof(ssi))
+        ;
+    if (!r->use_pidfd)
+        flags |= WEXITED;
+
+    for (;;) {
+        struct reaper_watch *w;
+        struct rusage ru;
+        siginfo_t info;
+
+        memset(&info, 0, sizeof(info));
+        if (waitid_rusage(P_ALL, 0, &info, flags, &ru) < 0 ||
+            info.si_pid == 0)
+            break;
+        w = hash_find(r, info.si_pid);
+        if (w)
+            dispatch_child(r, w, &info, &ru);
+    }
+}
+
+int reaper_run_once(struct reaper *r, int timeout_ms)
+{
+    struct epoll_event events[REAPER_EVENTS];
+    int i, n;
+
+    n = epoll_wait(r->epfd, events, REAPER_EVENTS, timeout_ms);
+    if (n < 0)
+        return errno == EINTR ? 0 : -1;
+
+    for (i = 0; i < n; i++) {
+        struct reaper_watch *w = events[i].data.ptr;
+
+        if (w == &r->sigwatch) {
+            handle_sigchld(r);
+            continue;
+        }
+        if (w->dead)
+            continue;
+        switch (w->kind) {
+        case REAPER_CHILD:
+            handle_pidfd(r, w);
+            break;
+        case REAPER_TIMER: {
+            uint64_t ticks;
+
+            if (read(w->fd, &ticks, sizeof(ticks)) < 0)
+                break;
+            w->cb.fd(r, w, events[i].events);
+            if (!w->periodic)
+                reaper_remove(r, w);
+            break;
+        }
+        case REAPER_FD:
+            w->cb.fd(r, w, events[i].events);
+            break;
+        }
+    }
+    reaper_bury(r);
+    return n;
+}
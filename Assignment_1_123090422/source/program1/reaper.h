@@ -0,0 +1,92 @@
+#ifndef REAPER_H
+#define REAPER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+/*
+ * Event driven child reaper.
+ *
+ * One epoll set watches children (through pidfds), plain fds such as the
+ * children's output pipes, and timerfd deadlines. Every epoll event carries
+ * a pointer to its watch, so dispatch is O(1) no matter how many children
+ * are outstanding. When pidfd_open() is not available the reaper falls back
+ * to a signalfd for SIGCHLD and looks children up in a pid hash table.
+ *
+ * pidfds only become readable on exit, so stop/continue notifications are
+ * always collected through the SIGCHLD signalfd. So are the ptrace stops of
+ * children the caller traces; those go to the watch's trap hook first.
+ */
+
+enum reaper_kind {
+    REAPER_CHILD,
+    REAPER_FD,
+    REAPER_TIMER,
+};
+
+struct reaper;
+struct reaper_watch;
+
+/* status is encoded like the one returned by waitpid(); ru is the child's
+ * resource usage as collected by waitid() */
+typedef void (*reaper_child_cb)(struct reaper *r, struct reaper_watch *w,
+                                int status, const struct rusage *ru);
+typedef void (*reaper_fd_cb)(struct reaper *r, struct reaper_watch *w,
+                             uint32_t events);
+/* a ptrace stop of a traced child, with the raw waitid() info (si_status
+ * keeps the PTRACE_EVENT bits); return 1 if it was handled, 0 to report
+ * it to the child callback as an ordinary stop */
+typedef int (*reaper_trap_cb)(struct reaper *r, struct reaper_watch *w,
+                              const siginfo_t *info);
+
+struct reaper_watch {
+    enum reaper_kind kind;
+    int fd;                     /* pidfd, watched fd or timerfd, -1 if none */
+    pid_t pid;
+    int dead;
+    int periodic;
+    union {
+        reaper_child_cb child;
+        reaper_fd_cb fd;
+    } cb;
+    reaper_trap_cb trap;        /* children only, NULL if not traced */
+    void *data;
+    struct reaper_watch *hnext; /* pid hash chain */
+    struct reaper_watch *fnext; /* deferred free list */
+};
+
+struct reaper {
+    int epfd;
+    int sigfd;
+    int use_pidfd;
+    int nchildren;
+    sigset_t oldmask;
+    struct reaper_watch sigwatch;
+    struct reaper_watch **buckets;
+    unsigned int nbuckets;
+    struct reaper_watch *graveyard;
+};
+
+int reaper_init(struct reaper *r);
+void reaper_destroy(struct reaper *r);
+
+/* restore the signal mask changed by reaper_init(); call in forked children */
+void reaper_child_setup(const struct reaper *r);
+
+struct reaper_watch *reaper_add_child(struct reaper *r, pid_t pid,
+                                      reaper_child_cb cb, void *data);
+struct reaper_watch *reaper_add_fd(struct reaper *r, int fd, uint32_t events,
+                                   reaper_fd_cb cb, void *data);
+/* timer firing after ms milliseconds and then every interval_ms; one shot
+ * timers (interval_ms == 0) are removed after their callback */
+struct reaper_watch *reaper_add_timer(struct reaper *r, long ms,
+                                      long interval_ms, reaper_fd_cb cb,
+                                      void *data);
+void reaper_remove(struct reaper *r, struct reaper_watch *w);
+
+/* wait up to timeout_ms (-1 forever) and dispatch the ready events */
+int reaper_run_once(struct reaper *r, int timeout_ms);
+
+#endif
@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "report.h"
+#include "../common/sigtab.h"
+
+static const char *const outcome_names[] = {
+    [OUTCOME_EXITED]    = "exited",
+    [OUTCOME_SIGNALED]  = "signaled",
+    [OUTCOME_STOPPED]   = "stopped",
+    [OUTCOME_CONTINUED] = "continued",
+    [OUTCOME_TIMEOUT]   = "timeout",
+    [OUTCOME_UNKNOWN]   = "unknown",
+};
+
+static const char *const limit_names[] = {
+    [LIMIT_NONE] = "none",
+    [LIMIT_WALL] = "wall",
+    [LIMIT_CPU]  = "cpu",
+};
+
+int report_parse_format(const char *name, enum report_format *format)
+{
+    if (strcmp(name, "text") == 0)
+        *format = REPORT_TEXT;
+    else if (strcmp(name, "jsonl") == 0)
+        *format = REPORT_JSONL;
+    else if (strcmp(name, "binary") == 0)
+        *format = REPORT_BINARY;
+    else
+        return -1;
+    return 0;
+}
+
+const char *report_outcome_name(enum report_outcome outcome)
+{
+    if (outcome > OUTCOME_UNKNOWN)
+        outcome = OUTCOME_UNKNOWN;
+    return outcome_names[outcome];
+}
+
+const char *report_limit_name(enum report_limit limit)
+{
+    if (limit > LIMIT_CPU)
+        limit = LIMIT_NONE;
+    return limit_names[limit];
+}
+
+static uint64_t tv_us(const struct timeval *tv)
+{
+    return (uint64_t)tv->tv_sec * 1000000ull + tv->tv_usec;
+}
+
+void report_fill(struct report_record *rec, pid_t pid, int status,
+                 const struct rusage *ru)
+{
+    memset(rec, 0, sizeof(*rec));
+    rec->size = sizeof(*rec);
+    rec->version = REPORT_VERSION;
+    rec->pid = pid;
+    rec->status = status;
+    if (WIFEXITED(status)) {
+        rec->outcome = OUTCOME_EXITED;
+        rec->exit_code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        rec->outcome = OUTCOME_SIGNALED;
+        rec->signo = WTERMSIG(status);
+        rec->core_dumped = WCOREDUMP(status) ? 1 : 0;
+    } else if (WIFSTOPPED(status)) {
+        rec->outcome = OUTCOME_STOPPED;
+        rec->signo = WSTOPSIG(status);
+    } else if (WIFCONTINUED(status)) {
+        rec->outcome = OUTCOME_CONTINUED;
+        rec->signo = SIGCONT;
+    } else {
+        rec->outcome = OUTCOME_UNKNOWN;
+    }
+    if (rec->signo)
+        snprintf(rec->signame, sizeof(rec->signame), "%s",
+                 sigtab_name(rec->signo));
+    rec->cg_memory_peak = -1;
+    rec->utime_us = tv_us(&ru->ru_utime);
+    rec->stime_us = tv_us(&ru->ru_stime);
+    rec->maxrss_kb = ru->ru_maxrss;
+    rec->minflt = ru->ru_minflt;
+    rec->majflt = ru->ru_majflt;
+    rec->nvcsw = ru->ru_nvcsw;
+    rec->nivcsw = ru->ru_nivcsw;
+}
+
+void report_init(struct report_out *out, enum report_format format, int fd)
+{
+    out->format = format;
+    out->fd = fd;
+    out->len = 0;
+}
+
+int report_flush(struct report_out *out)
+{
+    size_t off = 0;
+
+    while (off < out->len) {
+        ssize_t n = write(out->fd, out->buf + off, out->len - off);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            out->len = 0;
+            return -1;
+        }
+        off += n;
+    }
+    out->len = 0;
+    return 0;
+}
+
+/* make sure at least need bytes are free in the buffer */
+static void reserve(struct report_out *out, size_t need)
+{
+    if (out->len + need > sizeof(out->buf))
+        report_flush(out);
+}
+
+/* copy s as a JSON string body; program names are short, so escaping
+ * only quotes, backslashes and control characters is enough */
+static size_t json_escape(char *dst, size_t cap, const char *s)
+{
+    size_t n = 0;
+
+    for (; *s && n + 7 < cap; s++) {
+        unsigned char c = *s;
+
+        if (c == '"' || c == '\\') {
+            dst[n++] = '\\';
+            dst[n++] = c;
+        } else if (c < 0x20) {
+            n += snprintf(dst + n, cap - n, "\\u%04x", c);
+        } else {
+            dst[n++] = c;
+        }
+    }
+    dst[n] = '\0';
+    return n;
+}
+
+/* "null" or an object with the captured fault context */
+static int format_fault(char *buf, size_t len, const struct report_record *rec)
+{
+    if (!rec->fault_signo)
+        return snprintf(buf, len, "null");
+    return snprintf(buf, len, "{\"signal\":\"%s\",\"si_code\":%d,"
+                    "\"code_name\":\"%s\",\"addr\":\"0x%" PRIx64 "\","
+                    "\"ip\":\"0x%" PRIx64 "\",\"sender_pid\":%d}",
+                    sigtab_name(rec->fault_signo), rec->fault_code,
+                    sigtab_code_name(rec->fault_signo, rec->fault_code),
+                    rec->fault_addr, rec->fault_ip, rec->fault_sender);
+}
+
+static void emit_jsonl(struct report_out *out, const struct report_record *rec)
+{
+    char program[sizeof(rec->program) * 6 + 1];
+    char fault[256];
+    int n;
+
+    json_escape(program, sizeof(program), rec->program);
+    format_fault(fault, sizeof(fault), rec);
+    reserve(out, 1280);
+    n = snprintf(out->buf + out->len, sizeof(out->buf) - out->len,
+                 "{\"pid\":%d,\"program\":\"%s\",\"outcome\":\"%s\","
+                 "\"status\":%d,\"exit_code\":%d,\"signal\":%d,"
+                 "\"signal_name\":\"%s\",\"core_dumped\":%s,\"limit\":\"%s\","
+                 "\"start_ns\":%" PRIu64 ",\"wall_ns\":%" PRIu64 ","
+                 "\"running_ns\":%" PRIu64 ",\"stopped_ns\":%" PRIu64 ","
+                 "\"stops\":%u,\"continues\":%u,"
+                 "\"utime_us\":%" PRIu64 ",\"stime_us\":%" PRIu64 ","
+                 "\"maxrss_kb\":%" PRId64 ",\"minflt\":%" PRId64 ","
+                 "\"majflt\":%" PRId64 ",\"nvcsw\":%" PRId64 ","
+                 "\"nivcsw\":%" PRId64 ",\"cg_memory_peak\":%" PRId64 ","
+                 "\"cg_usage_us\":%" PRId64 ",\"cg_throttled_us\":%" PRId64 ","
+                 "\"cg_nr_throttled\":%" PRId64 ",\"fault\":%s}\n",
+                 rec->pid, program, report_outcome_name(rec->outcome),
+                 rec->status, rec->exit_code, rec->signo, rec->signame,
+                 rec->core_dumped ? "true" : "false",
+                 report_limit_name(rec->limit),
+                 rec->start_ns, rec->wall_ns, rec->running_ns, rec->stopped_ns,
+                 rec->nstops, rec->nconts, rec->utime_us, rec->stime_us,
+                 rec->maxrss_kb, rec->minflt, rec->majflt, rec->nvcsw,
+                 rec->nivcsw, rec->cg_memory_peak, rec->cg_usage_us,
+                 rec->cg_throttled_us, rec->cg_nr_throttled, fault);
+    if (n > 0 && out->len + n <= sizeof(out->buf))
+        out->len += n;
+}
+
+void report_emit(struct report_out *out, const struct report_record *rec)
+{
+    switch (out->format) {
+    case REPORT_JSONL:
+        emit_jsonl(out, rec);
+        break;
+    case REPORT_BINARY:
+        reserve(out, sizeof(*rec));
+        memcpy(out->buf + out->len, rec, sizeof(*rec));
+        out->len += sizeof(*rec);
+        break;
+    case REPORT_TEXT:
+        break;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/*
+ * Machine readable result records.
+ *
+ * Records are formatted into an in-memory buffer and written out with a
+ * single write() when the buffer fills up or report_flush() is called, so
+ * a busy batch does not pay one syscall per printf.
+ */
+
+enum report_format {
+    REPORT_TEXT,
+    REPORT_JSONL,
+    REPORT_BINARY,
+};
+
+enum report_outcome {
+    OUTCOME_EXITED,
+    OUTCOME_SIGNALED,
+    OUTCOME_STOPPED,
+    OUTCOME_CONTINUED,
+    OUTCOME_TIMEOUT,        /* killed by the supervisor for exceeding a limit */
+    OUTCOME_UNKNOWN,
+};
+
+/* which limit a timed out child exceeded */
+enum report_limit {
+    LIMIT_NONE,
+    LIMIT_WALL,
+    LIMIT_CPU,
+};
+
+#define REPORT_VERSION 5
+
+/* fixed size binary record, written in host byte order */
+struct report_record {
+    uint16_t size;              /* sizeof(struct report_record) */
+    uint16_t version;           /* REPORT_VERSION */
+    uint8_t outcome;            /* enum report_outcome */
+    uint8_t core_dumped;
+    uint8_t limit;              /* enum report_limit */
+    uint8_t pad;
+    int32_t pid;
+    int32_t status;             /* raw waitpid() status */
+    int32_t exit_code;          /* valid when the child exited */
+    int32_t signo;              /* terminating or stopping signal */
+    uint64_t start_ns;          /* CLOCK_REALTIME at launch */
+    uint64_t wall_ns;
+    uint64_t running_ns;        /* time spent running and stopped so far */
+    uint64_t stopped_ns;
+    uint32_t nstops;
+    uint32_t nconts;
+    int64_t cg_memory_peak;     /* cgroup memory.peak, -1 if unavailable */
+    int64_t cg_usage_us;        /* cgroup cpu.stat */
+    int64_t cg_throttled_us;
+    int64_t cg_nr_throttled;
+    uint64_t utime_us;
+    uint64_t stime_us;
+    int64_t maxrss_kb;
+    int64_t minflt;
+    int64_t majflt;
+    int64_t nvcsw;
+    int64_t nivcsw;
+    int32_t fault_signo;        /* signal the fault fields describe, 0 if
+                                 * no context was captured */
+    int32_t fault_code;         /* its si_code */
+    int32_t fault_sender;       /* si_pid when a process sent it */
+    uint32_t fault_pad;
+    uint64_t fault_addr;        /* faulting address of a hardware fault */
+    uint64_t fault_ip;          /* instruction pointer at delivery */
+    char signame[16];
+    char program[64];
+};
+
+#define REPORT_BUF_SIZE 65536
+
+struct report_out {
+    enum report_format format;
+    int fd;
+    size_t len;
+    char buf[REPORT_BUF_SIZE];
+};
+
+int report_parse_format(const char *name, enum report_format *format);
+const char *report_outcome_name(enum report_outcome outcome);
+const char *report_limit_name(enum report_limit limit);
+
+/* reset rec and fill in the header, the decoded waitpid() status with its
+ * signal name and the rusage counters; timing is left to the caller */
+void report_fill(struct report_record *rec, pid_t pid, int status,
+                 const struct rusage *ru);
+
+void report_init(struct report_out *out, enum report_format format, int fd);
+/* queue one record; only meaningful for the jsonl and binary formats */
+void report_emit(struct report_out *out, const struct report_record *rec);
+int report_flush(struct report_out *out);
+
+#endif
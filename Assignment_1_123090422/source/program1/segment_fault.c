@@ -3,11 +3,18 @@
 #include <unistd.h>
 
 int main(int argc,char* argv[]){
+#ifdef FAST
+	static const char msg[] = "This is the SIGSEGV program\n";
+
+	write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+	raise(SIGSEGV);
+#else
 	printf("------------CHILD PROCESS START------------\n");
 	printf("This is the SIGSEGV program\n\n");
 	raise(SIGSEGV);
 	sleep(5);
 	printf("------------CHILD PROCESS END------------\n");
+#endif
 
 	return 0;
 }
@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+"""Signal outcome regression and throughput suite for the test programs.
+
+Runs every program listed in outcomes.txt through program1 and, with
+--program2, through the program2 module, and checks the decoded outcome
+of each child against the manifest:
+
+    ./signal_suite.py                       # program1 only
+    sudo ./signal_suite.py --program2       # also insmod ../program2
+
+With --stress N every program is instead run N times on its own and the
+suite prints outcomes per second and wall time percentiles per signal.
+--fast uses the builds in fast/ (make fast-tests), which skip the banners
+and sleeps so the numbers are launch and teardown cost.
+Mismatches are counted in both modes and make the exit status 1.
+A full check also runs a missing program under every --spawn mode and
+expects each to report the failed exec the same way, with no record.
+
+program1 is run with --format=jsonl --capture=- so child output arrives
+framed and cannot corrupt the records. program2 results are read from
+/dev/program2 with ring_reader; the module needs root and a built
+program2.ko.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+PROGRAM2_DIR = os.path.join(HERE, '..', 'program2')
+
+# "<seq> target <i> pid <pid> <outcome>, wall <ms>ms, ..." from ring_reader
+RING_LINE = re.compile(r'^\d+ target (?P<target>\d+) pid (?P<pid>\d+) '
+                       r'(?:exited (?P<code>\d+)|stopped by (?P<stop>\S+)|'
+                       r'killed by (?P<sig>[^\s,]+)(?: \(core dumped\))?), '
+                       r'wall (?P<wall>[\d.]+)ms')
+
+
+def load_manifest(path):
+    expected = []
+    with open(path) as f:
+        for line in f:
+            fields = line.split('#', 1)[0].split()
+            if not fields:
+                continue
+            if len(fields) != 3 or \
+                    fields[1] not in ('exited', 'signaled', 'stopped'):
+                sys.exit('%s: bad line: %s' % (path, line.rstrip()))
+            expected.append((fields[0], (fields[1], fields[2])))
+    return expected
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def program1_records(data):
+    """Split program1 output into records, skipping captured frames."""
+    records = []
+    pos = 0
+    while pos < len(data):
+        nl = data.find(b'\n', pos)
+        if nl < 0:
+            nl = len(data)
+        line = data[pos:nl]
+        pos = nl + 1
+        if line.startswith(b'@@ '):
+            # "@@ <program> <pid> <stream> <time> <length>" then the bytes
+            pos += int(line.split()[-1])
+        elif line:
+            records.append(json.loads(line))
+    return records
+
+
+def run_program1(args, paths):
+    """Run paths through program1; returns [(path, outcome, wall_us)]."""
+    cmd = [args.program1, '-j', str(args.jobs), '--format=jsonl',
+           '--capture=-'] + paths
+    out = subprocess.run(cmd, stdout=subprocess.PIPE, check=False,
+                         timeout=args.timeout).stdout
+    by_name = {os.path.basename(p): p for p in paths}
+    results = []
+    seen = set()
+    for rec in program1_records(out):
+        # a stopped child is reported again when the stop policy ends it
+        if rec['pid'] in seen:
+            continue
+        seen.add(rec['pid'])
+        if rec['outcome'] == 'exited':
+            outcome = ('exited', str(rec['exit_code']))
+        else:
+            outcome = (rec['outcome'], rec['signal_name'])
+        results.append((by_name.get(rec['program'], rec['program']),
+                        outcome, rec['wall_ns'] / 1e3))
+    return results
+
+
+def run_program2(args, paths, repeat):
+    """Load program2 for paths, repeat times each, and read the ring."""
+    module = os.path.join(PROGRAM2_DIR, 'program2.ko')
+    reader = os.path.join(PROGRAM2_DIR, 'ring_reader')
+    stops = sum(1 for p in paths if args.expected[p][0] == 'stopped')
+    # a stop is followed by the SIGKILL that ends the child
+    nrecords = (len(paths) + stops) * repeat
+    subprocess.run(['insmod', module, 'paths=' + ','.join(paths),
+                    'repeat=%d' % repeat, 'max_inflight=%d' % args.jobs,
+                    'ring_records=%d' % max(nrecords, 16)], check=True)
+    try:
+        out = subprocess.run([reader, '-n', str(nrecords)],
+                             stdout=subprocess.PIPE, check=True,
+                             timeout=args.timeout).stdout
+    finally:
+        subprocess.run(['rmmod', 'program2'], check=False)
+    results = []
+    seen = set()
+    for line in out.decode().splitlines():
+        m = RING_LINE.match(line)
+        if not m or m.group('pid') in seen:
+            continue
+        seen.add(m.group('pid'))
+        if m.group('code') is not None:
+            outcome = ('exited', m.group('code'))
+        elif m.group('stop'):
+            outcome = ('stopped', m.group('stop'))
+        else:
+            outcome = ('signaled', m.group('sig'))
+        results.append((paths[int(m.group('target'))], outcome,
+                        float(m.group('wall')) * 1e3))
+    return results
+
+
+SPAWN_MODES = ('fork', 'vfork', 'posix_spawn', 'clone3')
+
+
+def check_spawn_errors(args):
+    """A missing program must fail to launch the same way in every mode."""
+    missing = os.path.join(HERE, 'no-such-program')
+    normal = os.path.join(os.path.dirname(args.program1), 'normal')
+    failed = 0
+    for mode in SPAWN_MODES:
+        proc = subprocess.run([args.program1, '--spawn=' + mode,
+                               '--format=jsonl', '--capture=-', missing,
+                               normal], stdout=subprocess.PIPE,
+                              stderr=subprocess.PIPE, check=False,
+                              timeout=args.timeout)
+        records = program1_records(proc.stdout)
+        want = '[no-such-program] %s failed: No such file or directory' % mode
+        ok = (proc.returncode == 1 and want in proc.stderr.decode() and
+              [r['program'] for r in records] == ['normal'])
+        failed += not ok
+        print('%-9s %-14s %-24s %s' %
+              ('program1', 'missing', 'spawn=' + mode, 'ok' if ok else
+               'FAIL, exit %d, records %s, stderr %r' %
+               (proc.returncode, [r['program'] for r in records],
+                proc.stderr.decode().strip())))
+    print('program1: %d/%d spawn modes report exec errors' %
+          (len(SPAWN_MODES) - failed, len(SPAWN_MODES)))
+    return failed
+
+
+def check(args, runner, run):
+    paths = list(args.expected)
+    results = run(paths)
+    failed = 0
+    got = {}
+    for path, outcome, _ in results:
+        got.setdefault(path, outcome)
+    for path in paths:
+        want = args.expected[path]
+        outcome = got.get(path)
+        ok = outcome == want
+        failed += not ok
+        print('%-9s %-14s %-24s %s' %
+              (runner, os.path.basename(path), ' '.join(want),
+               'ok' if ok else 'FAIL, got %s' %
+               (' '.join(outcome) if outcome else 'no result')))
+    print('%s: %d/%d passed' % (runner, len(paths) - failed, len(paths)))
+    return failed
+
+
+def stress(args, runner, run):
+    failed = 0
+    for path, want in args.expected.items():
+        start = time.monotonic()
+        results = run(path)
+        elapsed = time.monotonic() - start
+        wrong = sum(1 for _, outcome, _ in results if outcome != want)
+        wrong += max(0, args.stress - len(results))
+        failed += wrong
+        wall = sorted(w for _, _, w in results)
+        if not wall:
+            print('%-9s %-14s %-8s no results' %
+                  (runner, os.path.basename(path), want[1]))
+            continue
+        print('%-9s %-14s %-8s %7d %10.1f %10.1f %10.1f %10.1f %6d' %
+              (runner, os.path.basename(path),
+               want[1] if want[0] != 'exited' else 'exit ' + want[1],
+               len(results), len(results) / elapsed,
+               percentile(wall, 0.5), percentile(wall, 0.99), wall[-1],
+               wrong))
+    return failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--manifest', default=os.path.join(HERE,
+                                                           'outcomes.txt'))
+    parser.add_argument('--program1', default=os.path.join(HERE, 'program1'))
+    parser.add_argument('--program2', action='store_true',
+                        help='also run everything through the module')
+    parser.add_argument('--stress', type=int, metavar='N',
+                        help='run each program N times and report rates')
+    parser.add_argument('--fast', action='store_true',
+                        help='run the -DFAST builds from fast/')
+    parser.add_argument('-j', '--jobs', type=int, default=64,
+                        help='children running at once (default 64)')
+    parser.add_argument('--timeout', type=float, default=600,
+                        help='seconds allowed for one run (default 600)')
+    parser.add_argument('programs', nargs='*',
+                        help='subset of the manifest to run')
+    args = parser.parse_args()
+
+    expected = load_manifest(args.manifest)
+    if args.programs:
+        expected = [e for e in expected if e[0] in args.programs]
+    bindir = os.path.join(HERE, 'fast') if args.fast else HERE
+    args.expected = {os.path.join(bindir, name): want
+                     for name, want in expected}
+
+    runners = [('program1', lambda paths: run_program1(args, paths))]
+    if args.program2:
+        runners.append(('program2',
+                        lambda paths: run_program2(args, paths, 1)))
+
+    failed = 0
+    if not args.stress:
+        for runner, run in runners:
+            failed += check(args, runner, run)
+        if not args.programs:
+            failed += check_spawn_errors(args)
+        return 1 if failed else 0
+
+    print('%-9s %-14s %-8s %7s %10s %10s %10s %10s %6s' %
+          ('runner', 'program', 'signal', 'count', 'per_sec', 'p50_us',
+           'p99_us', 'max_us', 'wrong'))
+    stress_runners = [('program1', lambda path:
+                       run_program1(args, [path] * args.stress))]
+    if args.program2:
+        stress_runners.append(('program2', lambda path:
+                               run_program2(args, [path], args.stress)))
+    for runner, run in stress_runners:
+        failed += stress(args, runner, run)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,312 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+#include "spawn.h"
+
+#define CLONE_STACK_SIZE (64 * 1024)
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+/* struct clone_args from linux/sched.h, up to the cgroup field */
+struct clone3_args {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
+static const char *const mode_names[SPAWN_NR_MODES] = {
+    [SPAWN_FORK]        = "fork",
+    [SPAWN_VFORK]       = "vfork",
+    [SPAWN_POSIX_SPAWN] = "posix_spawn",
+    [SPAWN_CLONE]       = "clone3",
+};
+
+int spawn_parse_mode(const char *name, enum spawn_mode *mode)
+{
+    int i;
+
+    /* plain "clone" is accepted as an alias of the clone backend */
+    if (strcmp(name, "clone") == 0) {
+        *mode = SPAWN_CLONE;
+        return 0;
+    }
+    for (i = 0; i < SPAWN_NR_MODES; i++) {
+        if (strcmp(name, mode_names[i]) == 0) {
+            *mode = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *spawn_mode_name(enum spawn_mode mode)
+{
+    if (mode < 0 || mode >= SPAWN_NR_MODES)
+        return "unknown";
+    return mode_names[mode];
+}
+
+void spawn_opts_init(struct spawn_opts *opts)
+{
+    opts->path = NULL;
+    opts->envp = NULL;
+    opts->mask = NULL;
+    opts->stdio[0] = opts->stdio[1] = opts->stdio[2] = -1;
+    opts->cgroup_fd = -1;
+    opts->rlimits = NULL;
+    opts->nrlimits = 0;
+    opts->hold_fd = -1;
+}
+
+/* runs in the child between fork/vfork/clone and exec, so it may only use
+ * async-signal-safe calls */
+static int child_setup(const struct spawn_opts *opts, int join_cgroup)
+{
+    int i;
+
+    /* "0" moves the writing process itself */
+    if (join_cgroup && opts->cgroup_fd >= 0) {
+        int fd = openat(opts->cgroup_fd, "cgroup.procs", O_WRONLY);
+
+        if (fd < 0)
+            return -1;
+        if (write(fd, "0", 1) != 1) {
+            close(fd);
+            return -1;
+        }
+        close(fd);
+    }
+    for (i = 0; i < opts->nrlimits; i++)
+        if (setrlimit(opts->rlimits[i].resource, &opts->rlimits[i].lim) < 0)
+            return -1;
+    if (opts->mask)
+        sigprocmask(SIG_SETMASK, opts->mask, NULL);
+    for (i = 0; i < 3; i++)
+        if (opts->stdio[i] >= 0 && opts->stdio[i] != i)
+            dup2(opts->stdio[i], i);
+    if (opts->hold_fd >= 0) {
+        char c;
+
+        while (read(opts->hold_fd, &c, 1) < 0 && errno == EINTR)
+            ;
+    }
+    return 0;
+}
+
+static void child_exec(char *const argv[], const struct spawn_opts *opts)
+{
+    execve(opts->path ? opts->path : argv[0], argv,
+           opts->envp ? opts->envp : environ);
+}
+
+/* the child of a failed vfork/clone exec reaps itself through the parent */
+static pid_t reap_failed(pid_t pid, int err)
+{
+    waitpid(pid, NULL, 0);
+    errno = err;
+    return -1;
+}
+
+/* fork-like clone3 that starts the child inside the cgroup */
+static pid_t clone3_into_cgroup(int cgroup_fd)
+{
+#ifdef SYS_clone3
+    struct clone3_args args;
+
+    memset(&args, 0, sizeof(args));
+    args.flags = CLONE_INTO_CGROUP;
+    args.exit_signal = SIGCHLD;
+    args.cgroup = cgroup_fd;
+    return syscall(SYS_clone3, &args, sizeof(args));
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static pid_t spawn_fork(char *const argv[], const struct spawn_opts *opts)
+{
+    int join_cgroup = 0, errpipe[2] = { -1, -1 }, err;
+    pid_t pid = -1;
+    ssize_t n;
+
+    /* a held child cannot exec before we return, so it keeps reporting
+     * exec failures through its exit status */
+    if (opts->hold_fd < 0 && pipe2(errpipe, O_CLOEXEC) < 0)
+        return -1;
+    if (opts->cgroup_fd >= 0) {
+        pid = clone3_into_cgroup(opts->cgroup_fd);
+        /* older kernels: no clone3 or no CLONE_INTO_CGROUP */
+        if (pid < 0 && (errno == ENOSYS || errno == E2BIG ||
+                        errno == EINVAL))
+            join_cgroup = 1;
+        else if (pid < 0)
+            goto out;
+    }
+    if (pid < 0)
+        pid = fork();
+
+    if (pid == 0) {
+        if (child_setup(opts, join_cgroup) == 0)
+            child_exec(argv, opts);
+        err = errno;
+        if (errpipe[1] < 0) {
+            perror("execve failed");
+        } else {
+            /* a successful exec closes the pipe instead */
+            while (write(errpipe[1], &err, sizeof(err)) < 0 && errno == EINTR)
+                ;
+        }
+        _exit(127);
+    }
+out:
+    err = errno;
+    if (errpipe[1] >= 0) {
+        close(errpipe[1]);
+        if (pid > 0) {
+            while ((n = read(errpipe[0], &err, sizeof(err))) < 0 &&
+                   errno == EINTR)
+                ;
+            if (n == sizeof(err)) {
+                close(errpipe[0]);
+                return reap_failed(pid, err);
+            }
+        }
+        close(errpipe[0]);
+    }
+    errno = err;
+    return pid;
+}
+
+static pid_t spawn_vfork(char *const argv[], const struct spawn_opts *opts)
+{
+    /* the child runs in our address space, so it can hand errno back */
+    volatile int err = 0;
+    pid_t pid = vfork();
+
+    if (pid == 0) {
+        if (child_setup(opts, 1) == 0)
+            child_exec(argv, opts);
+        err = errno;
+        _exit(127);
+    }
+    if (pid > 0 && err)
+        return reap_failed(pid, err);
+    return pid;
+}
+
+static pid_t spawn_posix(char *const argv[], const struct spawn_opts *opts)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    pid_t pid;
+    int err, i;
+
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&actions);
+    if (opts->mask) {
+        posix_spawnattr_setsigmask(&attr, opts->mask);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+    }
+    for (i = 0; i < 3; i++)
+        if (opts->stdio[i] >= 0 && opts->stdio[i] != i)
+            posix_spawn_file_actions_adddup2(&actions, opts->stdio[i], i);
+    err = posix_spawn(&pid, opts->path ? opts->path : argv[0], &actions,
+                      &attr, argv, opts->envp ? opts->envp : environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+struct clone_exec {
+    char *const *argv;
+    const struct spawn_opts *opts;
+    int err;
+};
+
+static int clone_child(void *arg)
+{
+    struct clone_exec *ca = arg;
+
+    if (child_setup(ca->opts, 1) == 0)
+        child_exec(ca->argv, ca->opts);
+    ca->err = errno;
+    return 127;
+}
+
+static pid_t spawn_clone(char *const argv[], const struct spawn_opts *opts)
+{
+    static char *stack;
+    struct clone_exec ca = { argv, opts, 0 };
+    pid_t pid;
+
+    if (!stack) {
+        stack = mmap(NULL, CLONE_STACK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (stack == MAP_FAILED) {
+            stack = NULL;
+            return -1;
+        }
+    }
+    /* CLONE_VFORK suspends us until exec, so the stack is free again
+     * when clone() returns */
+    pid = clone(clone_child, stack + CLONE_STACK_SIZE,
+                CLONE_VM | CLONE_VFORK | SIGCHLD, &ca);
+    if (pid > 0 && ca.err)
+        return reap_failed(pid, ca.err);
+    return pid;
+}
+
+pid_t spawn_child(enum spawn_mode mode, char *const argv[],
+                  const struct spawn_opts *opts)
+{
+    struct spawn_opts defaults;
+
+    if (!opts) {
+        spawn_opts_init(&defaults);
+        opts = &defaults;
+    }
+    if (opts->hold_fd >= 0)
+        mode = SPAWN_FORK;
+    switch (mode) {
+    case SPAWN_FORK:
+        return spawn_fork(argv, opts);
+    case SPAWN_VFORK:
+        return spawn_vfork(argv, opts);
+    case SPAWN_POSIX_SPAWN:
+        if (opts->cgroup_fd >= 0 || opts->nrlimits > 0)
+            return spawn_vfork(argv, opts);
+        return spawn_posix(argv, opts);
+    case SPAWN_CLONE:
+        return spawn_clone(argv, opts);
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
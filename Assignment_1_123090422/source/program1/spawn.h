@@ -0,0 +1,69 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <sys/types.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+/*
+ * Child launch backends.
+ *
+ * fork copies the parent's page tables, so its cost grows with the size of
+ * the parent. vfork, posix_spawn and clone(CLONE_VM | CLONE_VFORK) share the
+ * parent's memory until the child calls exec, which keeps the launch cost
+ * flat. Every backend reports a failed exec (or failed setup before it)
+ * the same way: spawn_child() reaps the child and returns -1 with the
+ * child's errno. vfork and clone share memory with the child for this;
+ * fork reads the errno from a close-on-exec pipe that a successful exec
+ * closes.
+ *
+ * With a cgroup fd the fork backend becomes clone3(CLONE_INTO_CGROUP); the
+ * other backends, and fork on kernels without clone3, have the child write
+ * itself into cgroup.procs before exec. posix_spawn cannot run that step,
+ * so it is served by vfork when a cgroup or resource limits are requested.
+ *
+ * A child with a hold_fd waits before exec until the parent writes a byte
+ * to the pipe, e.g. to attach with ptrace first. Only a forked child can
+ * wait while the parent runs on, so holding always uses the fork backend,
+ * and a held child that fails to exec reports it through exit status 127
+ * instead.
+ */
+
+enum spawn_mode {
+    SPAWN_FORK,
+    SPAWN_VFORK,
+    SPAWN_POSIX_SPAWN,
+    SPAWN_CLONE,
+    SPAWN_NR_MODES,
+};
+
+int spawn_parse_mode(const char *name, enum spawn_mode *mode);
+const char *spawn_mode_name(enum spawn_mode mode);
+
+struct spawn_rlimit {
+    int resource;           /* RLIMIT_* */
+    struct rlimit lim;
+};
+
+struct spawn_opts {
+    const char *path;       /* program to exec, NULL for argv[0] */
+    char *const *envp;      /* NULL to inherit environ */
+    const sigset_t *mask;   /* child's signal mask, NULL to inherit */
+    int stdio[3];           /* fds dup'ed onto 0, 1 and 2, -1 to inherit */
+    int cgroup_fd;          /* cgroup v2 directory to start in, -1 if none */
+    const struct spawn_rlimit *rlimits;     /* applied with setrlimit() */
+    int nrlimits;
+    int hold_fd;            /* read end of a pipe to wait on, -1 if none */
+};
+
+void spawn_opts_init(struct spawn_opts *opts);
+
+/*
+ * Start opts->path (default argv[0]) with argv, applying opts (NULL for defaults) in the child
+ * before exec. Returns the child's pid, or -1 with errno set.
+ * Not thread safe: the clone backend reuses one static stack.
+ */
+pid_t spawn_child(enum spawn_mode mode, char *const argv[],
+                  const struct spawn_opts *opts);
+
+#endif
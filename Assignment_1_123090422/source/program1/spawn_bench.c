@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "spawn.h"
+
+/*
+ * Spawn latency benchmark: launches a program (normally ./normal) n times
+ * with every spawn backend and reports p50/p99 spawn-to-exit latency and
+ * throughput. -m allocates and touches a ballast so the page table cost of
+ * a large parent shows up in the fork numbers.
+ *
+ * Usage: spawn_bench [-n count] [-m ballast_MB] [program]
+ */
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int bench_mode(FILE *out, enum spawn_mode mode, char *argv[],
+                      double *lat, int n)
+{
+    double start = now_us(), total;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        double t0 = now_us();
+        pid_t pid = spawn_child(mode, argv, NULL);
+        int status;
+
+        if (pid < 0) {
+            fprintf(out, "%s: spawn failed: %s\n", spawn_mode_name(mode),
+                    strerror(errno));
+            return -1;
+        }
+        if (waitpid(pid, &status, 0) < 0) {
+            perror("waitpid");
+            return -1;
+        }
+        /* the fork backend can only report a failed exec this way */
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+            fprintf(out, "%s: %s could not be executed\n",
+                    spawn_mode_name(mode), argv[0]);
+            return -1;
+        }
+        lat[i] = now_us() - t0;
+    }
+    total = now_us() - start;
+
+    qsort(lat, n, sizeof(*lat), cmp_double);
+    fprintf(out, "%-12s n=%-6d p50=%8.1fus p99=%8.1fus %9.1f spawns/s\n",
+            spawn_mode_name(mode), n, lat[n / 2], lat[(int)(n * 0.99)],
+            n / (total / 1e6));
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char *child_argv[2] = { "./normal", NULL };
+    long ballast_mb = 0;
+    int n = 10000, opt, i, devnull, ret = 0;
+    double *lat;
+    FILE *out;
+
+    while ((opt = getopt(argc, argv, "n:m:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 'm':
+            ballast_mb = atol(optarg);
+            break;
+        default:
+            fprintf(stderr,
+                    "Usage: %s [-n count] [-m ballast_MB] [program]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        child_argv[0] = argv[optind];
+    if (n <= 0)
+        n = 1;
+
+    if (ballast_mb > 0) {
+        char *ballast = malloc(ballast_mb << 20);
+
+        if (!ballast) {
+            perror("malloc");
+            return 1;
+        }
+        memset(ballast, 1, ballast_mb << 20);
+    }
+
+    lat = malloc(n * sizeof(*lat));
+    if (!lat) {
+        perror("malloc");
+        return 1;
+    }
+
+    /* children inherit stdout; send their banners to /dev/null and keep
+     * our own report on a private copy of the descriptor */
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    devnull = open("/dev/null", O_WRONLY);
+    if (!out || devnull < 0) {
+        perror("open");
+        return 1;
+    }
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    fprintf(out, "spawning %s %d times per backend, ballast %ld MB\n",
+            child_argv[0], n, ballast_mb);
+    for (i = 0; i < SPAWN_NR_MODES; i++)
+        if (bench_mode(out, i, child_argv, lat, n) < 0)
+            ret = 1;
+
+    fclose(out);
+    free(lat);
+    return ret;
+}
@@ -4,12 +4,19 @@
 #include <stdlib.h>
 
 int main(int argc,char* argv[]){
+#ifdef FAST
+	static const char msg[] = "This is the SIGSTOP program\n";
+
+	write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+	raise(SIGSTOP);
+#else
 	printf("------------CHILD PROCESS START------------\n");
 	printf("This is the SIGSTOP program\n\n");
 	raise(SIGSTOP);
 	sleep(5);
 //	raise(SIGCONT);
 	printf("------------CHILD PROCESS END------------\n");
+#endif
 
 	return 0;
 }
@@ -9,9 +9,128 @@
 #include <linux/jiffies.h>
 #include <linux/kmod.h>
 #include <linux/fs.h>
+#include <linux/moduleparam.h>
+#include <linux/string.h>
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/miscdevice.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/version.h>
+
+#include "program2_ring.h"
+#include "program2_stats.h"
+#include "../common/sigtab.h"
+
+#define CREATE_TRACE_POINTS
+#include "program2_trace.h"
 
 MODULE_LICENSE("GPL");
 
+/* renamed from complete_and_exit() in 5.17 */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 17, 0)
+#define kthread_complete_and_exit complete_and_exit
+#endif
+
+#define PROGRAM2_MAX_TARGETS 64
+#define PROGRAM2_MAX_ENV 16
+
+/*
+ * Batch parameters, e.g.
+ *   insmod program2.ko paths=/tmp/abort,/tmp/normal args="-v","" \
+ *          env=HOME=/,PATH=/bin max_workers=1 max_inflight=8 repeat=1
+ * args[i] holds the space separated arguments of paths[i]; the env list is
+ * shared by all targets. Without paths the module runs /tmp/test once.
+ * repeat runs the whole list that many times, for stress runs.
+ */
+static char *paths[PROGRAM2_MAX_TARGETS];
+static int npaths;
+module_param_array(paths, charp, &npaths, 0444);
+MODULE_PARM_DESC(paths, "comma separated executables to run");
+
+static char *args[PROGRAM2_MAX_TARGETS];
+static int nargs;
+module_param_array(args, charp, &nargs, 0444);
+MODULE_PARM_DESC(args, "space separated arguments, one entry per path");
+
+static char *env[PROGRAM2_MAX_ENV];
+static int nenv;
+module_param_array(env, charp, &nenv, 0444);
+MODULE_PARM_DESC(env, "environment of every target (VAR=value,...)");
+
+static int max_workers = 1;
+module_param(max_workers, int, 0444);
+MODULE_PARM_DESC(max_workers, "number of launcher threads");
+
+static int max_inflight = 16;
+module_param(max_inflight, int, 0444);
+MODULE_PARM_DESC(max_inflight, "children each launcher keeps running at once");
+
+static int repeat = 1;
+module_param(repeat, int, 0444);
+MODULE_PARM_DESC(repeat, "times every target is run");
+
+static unsigned int ring_records = 4096;
+module_param(ring_records, uint, 0444);
+MODULE_PARM_DESC(ring_records, "result ring size, rounded up to a power of two");
+
+static bool verbose;
+module_param(verbose, bool, 0644);
+MODULE_PARM_DESC(verbose, "also printk every outcome");
+
+struct p2_target {
+	int index;		/* into the paths parameter */
+	const char *path;
+	char **argv;		/* argv[0] is the path, shared by repeats */
+	char **split;		/* argv_split() result backing argv[1..] */
+	pid_t pid;
+	struct pid *pid_ref;	/* held from clone until the child is reaped */
+	struct list_head node;	/* on its worker's children list */
+	int status;
+	u64 start_ns;
+	u64 end_ns;
+	struct rusage ru;
+};
+
+static struct p2_target *targets;	/* repeat runs of ntargets each */
+static int ntargets;
+static int nruns;
+static char **target_envp;
+static atomic_t next_target = ATOMIC_INIT(0);
+
+/*
+ * A launcher thread keeps up to max_inflight children running. Exits and
+ * stops wake it through an entry on its own wait_chldexit queue, and it
+ * reaps whatever is ready with WNOHANG, so it never blocks on one child.
+ */
+struct p2_worker {
+	struct task_struct *task;	/* referenced until module exit */
+	wait_queue_entry_t chld_wait;
+	bool events;			/* a child changed state */
+	bool killed;			/* children got SIGKILL for teardown */
+	int inflight;
+	struct list_head children;
+};
+
+static struct p2_worker *workers;
+static int nworkers;
+static atomic_t live_workers = ATOMIC_INIT(0);
+static DECLARE_COMPLETION(workers_done);
+static bool stopping;
+
+static char *default_path = "/tmp/test";
+static char *default_envp[] = { "HOME=/",
+				"PATH=/sbin:/bin:/usr/sbin:/usr/bin", NULL };
+
 struct wait_opts {
 	enum pid_type wo_type;
 	int wo_flags;
@@ -31,12 +150,15 @@ extern int do_execve(struct filename *filename,
 		     const char __user *const __user *__argv,
 		     const char __user *const __user *__envp);
 extern long do_wait(struct wait_opts *wo);
+/* like do_execve, but argv and envp are kernel pointers */
+extern int kernel_execve(const char *filename,
+			 const char *const *argv, const char *const *envp);
 
-int my_fork(void *argc);
+int my_fork(struct p2_target *target);
 
-int my_exec(void);
+int my_exec(void *data);
 
-void my_wait(pid_t pid);
+pid_t my_wait(int *status, struct rusage *ru);
 
 int wifexited(int status);
 int wexitstatus(int status);
@@ -72,27 +194,294 @@ int wifstopped(int status)
 
 int wstopsig(int status)
 {
-	return (((status) & (0xff00) >> 8));
+	return (((status) & 0xff00) >> 8);
 }
 
-//implement fork function
-int my_fork(void *argc)
+/*
+ * /proc/program2: per-CPU counters, summed when read
+ */
+
+static DEFINE_PER_CPU(struct p2_stats, p2_stats);
+static struct proc_dir_entry *p2_proc_dir;
+
+static const char *const phase_names[P2_NR_PHASES] = {
+	[P2_PHASE_CLONE] = "clone",
+	[P2_PHASE_EXEC] = "exec",
+	[P2_PHASE_WAIT] = "wait",
+};
+
+#define p2_stat_inc(field) this_cpu_inc(p2_stats.field)
+
+static void p2_stat_phase(enum p2_phase phase, u64 ns)
 {
-	pid_t parent_pid = current->pid;
-	pid_t child_pid;
+	int b = ns ? min_t(int, ilog2(ns), P2_HIST_BUCKETS - 1) : 0;
 
-	//set default sigaction for current process
-	int i;
+	this_cpu_inc(p2_stats.phase_count[phase]);
+	this_cpu_add(p2_stats.phase_sum_ns[phase], ns);
+	this_cpu_inc(p2_stats.hist[phase][b]);
+}
 
-	struct kernel_clone_args args = { .flags = SIGCHLD,
-					   .exit_signal = SIGCHLD,
-					   .child_tid = NULL,
-					   .parent_tid = NULL,
-					   .stack = (unsigned long)&my_exec,
-					   .stack_size = 0,
-					   .tls = 0 };
+static void p2_stat_outcome(int status)
+{
+	struct sigtab_status st;
+
+	sigtab_decode(status, &st);
+	p2_stat_inc(waits);
+	switch (st.kind) {
+	case SIGTAB_EXITED:
+		p2_stat_inc(exited);
+		if (st.code)
+			p2_stat_inc(exited_nonzero);
+		break;
+	case SIGTAB_STOPPED:
+		p2_stat_inc(stopped);
+		break;
+	case SIGTAB_SIGNALED:
+		p2_stat_inc(signaled);
+		if (st.core)
+			p2_stat_inc(core_dumped);
+		break;
+	}
+	if (st.signo > 0 && st.signo < P2_NSIG)
+		this_cpu_inc(p2_stats.signals[st.signo]);
+}
+
+/* readers may see a sum that is a few updates behind, never a torn one */
+static void p2_stats_sum(struct p2_stats *sum)
+{
+	u64 *dst = (u64 *)&sum->clones;
+	size_t i, n = (sizeof(*sum) - offsetof(struct p2_stats, clones)) /
+		      sizeof(u64);
+	int cpu;
+
+	memset(sum, 0, sizeof(*sum));
+	sum->version = P2_STATS_VERSION;
+	sum->size = sizeof(*sum);
+	for_each_possible_cpu(cpu) {
+		const u64 *src = (const u64 *)&per_cpu(p2_stats, cpu).clones;
+
+		for (i = 0; i < n; i++)
+			dst[i] += READ_ONCE(src[i]);
+	}
+}
+
+static int p2_stats_show(struct seq_file *m, void *v)
+{
+	struct p2_stats *st = kmalloc(sizeof(*st), GFP_KERNEL);
+	int i, b;
+
+	if (!st)
+		return -ENOMEM;
+	p2_stats_sum(st);
+	seq_printf(m, "version %u\n", st->version);
+	seq_printf(m, "counter clones %llu\n", st->clones);
+	seq_printf(m, "counter clone_failures %llu\n", st->clone_failures);
+	seq_printf(m, "counter execs %llu\n", st->execs);
+	seq_printf(m, "counter exec_failures %llu\n", st->exec_failures);
+	seq_printf(m, "counter waits %llu\n", st->waits);
+	seq_printf(m, "counter exited %llu\n", st->exited);
+	seq_printf(m, "counter exited_nonzero %llu\n", st->exited_nonzero);
+	seq_printf(m, "counter signaled %llu\n", st->signaled);
+	seq_printf(m, "counter stopped %llu\n", st->stopped);
+	seq_printf(m, "counter core_dumped %llu\n", st->core_dumped);
+	for (i = 1; i < P2_NSIG; i++)
+		if (st->signals[i])
+			seq_printf(m, "signal %d %llu\n", i, st->signals[i]);
+	for (i = 0; i < P2_NR_PHASES; i++)
+		seq_printf(m, "phase %s count %llu sum_ns %llu\n",
+			   phase_names[i], st->phase_count[i],
+			   st->phase_sum_ns[i]);
+	for (i = 0; i < P2_NR_PHASES; i++)
+		for (b = 0; b < P2_HIST_BUCKETS; b++)
+			if (st->hist[i][b])
+				seq_printf(m, "hist %s %llu %llu\n",
+					   phase_names[i], b ? 1ULL << b : 0,
+					   st->hist[i][b]);
+	kfree(st);
+	return 0;
+}
+
+static ssize_t p2_stats_bin_read(struct file *file, char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	struct p2_stats *st = kmalloc(sizeof(*st), GFP_KERNEL);
+	ssize_t ret;
+
+	if (!st)
+		return -ENOMEM;
+	p2_stats_sum(st);
+	ret = simple_read_from_buffer(buf, count, ppos, st, sizeof(*st));
+	kfree(st);
+	return ret;
+}
+
+static const struct proc_ops p2_stats_bin_ops = {
+	.proc_read = p2_stats_bin_read,
+	.proc_lseek = default_llseek,
+};
+
+static int p2_proc_init(void)
+{
+	p2_proc_dir = proc_mkdir("program2", NULL);
+	if (!p2_proc_dir)
+		return -ENOMEM;
+	if (!proc_create_single("stats", 0444, p2_proc_dir, p2_stats_show) ||
+	    !proc_create("stats.bin", 0444, p2_proc_dir, &p2_stats_bin_ops)) {
+		proc_remove(p2_proc_dir);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+/*
+ * /dev/program2: one binary record per reaped child
+ */
+
+static struct p2_ring_header *ring;
+static struct p2_record *ring_data;
+static DEFINE_SPINLOCK(ring_lock);
+static DECLARE_WAIT_QUEUE_HEAD(ring_wait);
+static atomic_t ring_opened = ATOMIC_INIT(0);
+
+static int ring_alloc(void)
+{
+	unsigned int nr = roundup_pow_of_two(clamp(ring_records, 16U, 1U << 20));
+	size_t size = PAGE_SIZE + PAGE_ALIGN(nr * sizeof(struct p2_record));
+
+	/* zeroed and safe to hand to remap_vmalloc_range() */
+	ring = vmalloc_user(size);
+	if (!ring)
+		return -ENOMEM;
+	ring->version = P2_RING_VERSION;
+	ring->record_size = sizeof(struct p2_record);
+	ring->nr_records = nr;
+	ring->data_offset = PAGE_SIZE;
+	ring_data = (struct p2_record *)((char *)ring + PAGE_SIZE);
+	return 0;
+}
+
+static bool ring_empty(void)
+{
+	return smp_load_acquire(&ring->head) == READ_ONCE(ring->tail);
+}
+
+static void ring_push(const struct p2_target *target)
+{
+	struct p2_record *rec;
+	struct sigtab_status st;
+	u64 head;
+
+	/* several workers produce, the reader only moves tail */
+	spin_lock(&ring_lock);
+	head = ring->head;
+	if (head - smp_load_acquire(&ring->tail) >= ring->nr_records) {
+		ring->lost++;
+		spin_unlock(&ring_lock);
+		return;
+	}
+	rec = &ring_data[head & (ring->nr_records - 1)];
+	memset(rec, 0, sizeof(*rec));
+	rec->seq = head;
+	rec->pid = target->pid;
+	rec->status = target->status;
+	rec->target = target->index;
+	sigtab_decode(target->status, &st);
+	rec->exited = st.kind == SIGTAB_EXITED;
+	rec->signaled = st.kind == SIGTAB_SIGNALED;
+	rec->stopped = st.kind == SIGTAB_STOPPED;
+	rec->core_dumped = st.core;
+	rec->exit_code = st.code;
+	rec->signo = st.signo;
+	rec->start_ns = target->start_ns;
+	rec->end_ns = target->end_ns;
+	rec->utime_ns = target->ru.ru_utime.tv_sec * NSEC_PER_SEC +
+			target->ru.ru_utime.tv_usec * NSEC_PER_USEC;
+	rec->stime_ns = target->ru.ru_stime.tv_sec * NSEC_PER_SEC +
+			target->ru.ru_stime.tv_usec * NSEC_PER_USEC;
+	smp_store_release(&ring->head, head + 1);
+	spin_unlock(&ring_lock);
+
+	wake_up_interruptible(&ring_wait);
+}
+
+/* the ring has a single consumer */
+static int p2_dev_open(struct inode *inode, struct file *file)
+{
+	if (atomic_cmpxchg(&ring_opened, 0, 1))
+		return -EBUSY;
+	return 0;
+}
+
+static int p2_dev_release(struct inode *inode, struct file *file)
+{
+	atomic_set(&ring_opened, 0);
+	return 0;
+}
+
+static ssize_t p2_dev_read(struct file *file, char __user *buf, size_t count,
+			   loff_t *ppos)
+{
+	u64 head, tail;
+	size_t n = 0;
+
+	if (count < sizeof(struct p2_record))
+		return -EINVAL;
+	while (ring_empty()) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(ring_wait, !ring_empty()))
+			return -ERESTARTSYS;
+	}
+
+	tail = READ_ONCE(ring->tail);
+	head = smp_load_acquire(&ring->head);
+	while (tail != head && n + sizeof(struct p2_record) <= count) {
+		if (copy_to_user(buf + n,
+				 &ring_data[tail & (ring->nr_records - 1)],
+				 sizeof(struct p2_record)))
+			break;
+		n += sizeof(struct p2_record);
+		tail++;
+	}
+	smp_store_release(&ring->tail, tail);
+	return n ? n : -EFAULT;
+}
+
+static __poll_t p2_dev_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &ring_wait, wait);
+	return ring_empty() ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
+/* the reader writes tail through the mapping, so it is mapped shared */
+static int p2_dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	return remap_vmalloc_range(vma, ring, vma->vm_pgoff);
+}
+
+static const struct file_operations p2_dev_fops = {
+	.owner = THIS_MODULE,
+	.open = p2_dev_open,
+	.release = p2_dev_release,
+	.read = p2_dev_read,
+	.poll = p2_dev_poll,
+	.mmap = p2_dev_mmap,
+	.llseek = noop_llseek,
+};
+
+static struct miscdevice p2_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "program2",
+	.fops = &p2_dev_fops,
+	.mode = 0600,
+};
 
+/* set default sigaction for current process */
+static void reset_sigactions(void)
+{
 	struct k_sigaction *k_action = &current->sighand->action[0];
+	int i;
+
 	for (i = 0; i < _NSIG; i++) {
 		k_action->sa.sa_handler = SIG_DFL;
 		k_action->sa.sa_flags = 0;
@@ -100,179 +489,385 @@ int my_fork(void *argc)
 		sigemptyset(&k_action->sa.sa_mask);
 		k_action++;
 	}
+}
+
+//implement fork function
+int my_fork(struct p2_target *target)
+{
+	pid_t parent_pid = current->pid;
+	pid_t child_pid;
+
+	/* for a kthread parent, stack is the entry point and stack_size its
+	 * argument */
+	struct kernel_clone_args args = { .flags = SIGCHLD,
+					   .exit_signal = SIGCHLD,
+					   .child_tid = NULL,
+					   .parent_tid = NULL,
+					   .stack = (unsigned long)&my_exec,
+					   .stack_size = (unsigned long)target,
+					   .tls = 0 };
 
 	/* fork a process using kernel_clone or kernel_thread */
+	trace_program2_clone_start(target->index, target->path);
+	target->start_ns = ktime_get_ns();
 	child_pid = kernel_clone(&args);
-	printk("[program2] : The child process has pid = %d\n", child_pid);
-
-	/* wait until child process terminates */
-	printk("[program2] : This is the parent process, pid = %d\n",
-	       parent_pid);
-	printk("[program2] : child process\n");
-	my_wait(child_pid);
+	trace_program2_clone_finish(target->index, child_pid);
+	p2_stat_phase(P2_PHASE_CLONE, ktime_get_ns() - target->start_ns);
+	if (child_pid < 0) {
+		p2_stat_inc(clone_failures);
+		printk("[program2] : %s: kernel_clone failed (%d)\n",
+		       target->path, child_pid);
+		return child_pid;
+	}
+	p2_stat_inc(clones);
+	target->pid = child_pid;
+	/* an unreaped child keeps its struct pid, so this cannot fail */
+	target->pid_ref = find_get_pid(child_pid);
+	if (verbose) {
+		printk("[program2] : The child process has pid = %d\n",
+		       child_pid);
+		printk("[program2] : This is the parent process, pid = %d\n",
+		       parent_pid);
+		printk("[program2] : child process\n");
+	}
 
 	return 0;
 }
 
-int my_exec(void)
+int my_exec(void *data)
 {
-	char path[] = "/tmp/test";
-	struct filename *file_pointer = getname_kernel(path); 
-
-	do_execve(file_pointer, NULL, NULL);
+	struct p2_target *target = data;
+	u64 start;
+	int ret;
+
+	trace_program2_exec_start(target->index, target->path);
+	start = ktime_get_ns();
+	ret = kernel_execve(target->path, (const char *const *)target->argv,
+			    (const char *const *)target_envp);
+	trace_program2_exec_result(target->index, ret);
+	p2_stat_phase(P2_PHASE_EXEC, ktime_get_ns() - start);
+	/* success returns into the new program's user context */
+	if (!ret) {
+		p2_stat_inc(execs);
+		return 0;
+	}
+	p2_stat_inc(exec_failures);
+	printk("[program2] : %s: exec failed (%d)\n", target->path, ret);
+	/* there is no user context to return to; report it like a shell */
+	do_exit(127 << 8);
 
 	return 0;
 }
 
-void my_wait(pid_t pid)
+/* one printk line per outcome; off by default, the ring carries the
+ * results */
+static void print_status(int stat)
+{
+	const struct sigtab_entry *e;
+	struct sigtab_status st;
+
+	sigtab_decode(stat, &st);
+	if (st.kind == SIGTAB_EXITED) {
+		printk("[program2] : child process exits normally, status %d\n",
+		       st.code);
+		return;
+	}
+	e = sigtab_get(st.signo);
+	printk("[program2] : get %s signal, child process %s%s, "
+	       "the return signal is %d\n", e ? e->name : "unknown",
+	       e ? e->desc : "got an unknown signal",
+	       st.core ? " (core dumped)" : "", st.signo);
+}
+
+/* reap any child of this thread that has exited or stopped, without
+ * blocking; returns its pid, 0 if none is ready, or -ECHILD */
+pid_t my_wait(int *status, struct rusage *ru)
 {
-	int status;
-	int a;
 	struct wait_opts wopt;
-	struct pid *wo_pid_ptr = NULL;
-	enum pid_type type;
-	type = PIDTYPE_PID;
-	wo_pid_ptr = find_get_pid(pid);
-
-	wopt.wo_type = type;
-	wopt.wo_pid = wo_pid_ptr;
-	wopt.wo_flags = WUNTRACED | WEXITED;
+	long ret;
+
+	wopt.wo_type = PIDTYPE_MAX;	/* P_ALL */
+	wopt.wo_pid = NULL;
+	wopt.wo_flags = WUNTRACED | WEXITED | WNOHANG;
 	wopt.wo_info = NULL;
-	wopt.wo_stat = status;
-	wopt.wo_rusage = NULL;
+	wopt.wo_stat = 0;
+	wopt.wo_rusage = ru;
 
-	a = do_wait(&wopt);
+	ret = do_wait(&wopt);
+	*status = wopt.wo_stat;
+	return ret;
+}
 
-	switch ((wopt.wo_stat) & 0x7f) {
-	case 1: {
-		printk("[program2] : get SIGHUP signal\n");
-		printk("[program2] : child process hangs up controlling terminal or process\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
-	}
-	case 2: {
-		printk("[program2] : get SIGINT signal\n");
-		printk("[program2] : child process has interrupt from keyboard\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
-	}	
-	case 3: {
-		printk("[program2] : get SIGQUIT signal\n");
-		printk("[program2] : child process quits from keyboard\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
+/* runs in the exiting or stopping child's context: just note and wake */
+static int p2_child_wake(wait_queue_entry_t *wq, unsigned int mode, int sync,
+			 void *key)
+{
+	struct p2_worker *w = container_of(wq, struct p2_worker, chld_wait);
+
+	WRITE_ONCE(w->events, true);
+	wake_up_process(w->task);
+	return 0;
+}
+
+static void p2_child_event(struct p2_worker *w, struct p2_target *target,
+			   int status, const struct rusage *ru)
+{
+	target->status = status;
+	target->ru = *ru;
+	target->end_ns = ktime_get_ns();
+	trace_program2_wait_result(target->index, target->pid, status);
+	p2_stat_outcome(status);
+	ring_push(target);
+	if (verbose)
+		print_status(status);
+
+	/* nobody is going to resume it, and the batch must finish */
+	if (wifstopped(status)) {
+		kill_pid(target->pid_ref, SIGKILL, 1);
+		return;
 	}
-	case 4: {
-		printk("[program2] : get SIGILL signal\n");
-		printk("[program2] : child process has illegal instruction\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
-	}	
-	case 5: {
-		printk("[program2] : get SIGTRAP signal\n");
-		printk("[program2] : child process has breakpoint for debugging\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
+	p2_stat_phase(P2_PHASE_WAIT, target->end_ns - target->start_ns);
+	if (verbose)
+		printk("[program2] : target %d %s (pid %d) done, status %#x\n",
+		       target->index, target->path, target->pid,
+		       status);
+	list_del(&target->node);
+	put_pid(target->pid_ref);
+	target->pid_ref = NULL;
+	w->inflight--;
+}
+
+static void p2_reap_ready(struct p2_worker *w)
+{
+	struct p2_target *target;
+	struct rusage ru;
+	int status;
+	pid_t pid;
+
+	while ((pid = my_wait(&status, &ru)) > 0) {
+		list_for_each_entry(target, &w->children, node) {
+			if (target->pid == pid) {
+				p2_child_event(w, target, status, &ru);
+				break;
+			}
+		}
 	}
-	case 6: {
-		printk("[program2] : get SIGABRT signal\n");
-		printk("[program2] : child process is aborted\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
-	}	
-	case 7: {
-		printk("[program2] : get SIGBUS signal\n");
-		printk("[program2] : child process has bus error\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
-	}	
-	case 8: {
-		printk("[program2] : get SIGFPE signal\n");
-		printk("[program2] : child process has floating-point exception\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
-	}	
-	case 9: {
-		printk("[program2] : get SIGKILL signal\n");
-		printk("[program2] : child process has forced-process termination\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
+}
+
+/* start targets while there is room, then sleep until a child changes
+ * state; module exit kills whatever is still running */
+static int p2_worker(void *data)
+{
+	struct p2_worker *w = data;
+	struct p2_target *target;
+	int idx;
+
+	reset_sigactions();
+	INIT_LIST_HEAD(&w->children);
+	init_waitqueue_func_entry(&w->chld_wait, p2_child_wake);
+	add_wait_queue(&current->signal->wait_chldexit, &w->chld_wait);
+
+	for (;;) {
+		while (!READ_ONCE(stopping) && w->inflight < max_inflight) {
+			idx = atomic_inc_return(&next_target) - 1;
+			if (idx >= nruns)
+				break;
+			target = &targets[idx];
+			if (my_fork(target) < 0)
+				continue;
+			list_add_tail(&target->node, &w->children);
+			w->inflight++;
+		}
+		if (READ_ONCE(stopping) && !w->killed) {
+			list_for_each_entry(target, &w->children, node)
+				kill_pid(target->pid_ref, SIGKILL, 1);
+			w->killed = true;
+		}
+		if (!w->inflight &&
+		    (READ_ONCE(stopping) || atomic_read(&next_target) >= nruns))
+			break;
+
+		/* the state is set first, so a wakeup after the check is kept */
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!READ_ONCE(w->events) && (!READ_ONCE(stopping) || w->killed))
+			schedule();
+		__set_current_state(TASK_RUNNING);
+		WRITE_ONCE(w->events, false);
+		p2_reap_ready(w);
 	}
-	case 11: {
-		printk("[program2] : get SIGSEGV signal\n");
-		printk("[program2] : child process has illegal memory reference\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
+
+	remove_wait_queue(&current->signal->wait_chldexit, &w->chld_wait);
+	if (atomic_dec_and_test(&live_workers))
+		printk("[program2] : batch of %d runs finished\n",
+		       nruns);
+	/* completing from do_exit() means no worker is left in module text
+	 * once program2_exit() has seen every completion */
+	kthread_complete_and_exit(&workers_done, 0);
+}
+
+static int p2_setup_target(struct p2_target *target, int index, char *path,
+			   char *arg)
+{
+	int argc = 0, i;
+
+	target->index = index;
+	target->path = path;
+	if (arg && *arg) {
+		target->split = argv_split(GFP_KERNEL, arg, &argc);
+		if (!target->split)
+			return -ENOMEM;
 	}
-	case 13: {
-		printk("[program2] : get SIGPIPE signal\n");
-		printk("[program2] : child process writes to pipe with no readers\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
+	target->argv = kcalloc(argc + 2, sizeof(char *), GFP_KERNEL);
+	if (!target->argv)
+		return -ENOMEM;
+	target->argv[0] = path;
+	for (i = 0; i < argc; i++)
+		target->argv[i + 1] = target->split[i];
+	return 0;
+}
+
+static void p2_free_targets(void)
+{
+	int i;
+
+	for (i = 0; i < ntargets; i++) {
+		kfree(targets[i].argv);
+		if (targets[i].split)
+			argv_free(targets[i].split);
 	}
-	case 14: {
-		printk("[program2] : get SIGALRM signal\n");
-		printk("[program2] : child process is alarmed\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
+	kvfree(targets);
+	targets = NULL;
+	if (target_envp != default_envp)
+		kfree(target_envp);
+	target_envp = NULL;
+}
+
+static int p2_setup_batch(void)
+{
+	int i, ret;
+
+	ntargets = npaths ? npaths : 1;
+	repeat = clamp(repeat, 1, INT_MAX / ntargets);
+	nruns = ntargets * repeat;
+	targets = kvcalloc(nruns, sizeof(*targets), GFP_KERNEL);
+	if (!targets)
+		return -ENOMEM;
+	for (i = 0; i < ntargets; i++) {
+		ret = p2_setup_target(&targets[i], i,
+				      npaths ? paths[i] : default_path,
+				      i < nargs ? args[i] : NULL);
+		if (ret)
+			goto fail;
 	}
-	case 15: {
-		printk("[program2] : get SIGTERM signal\n");
-		printk("[program2] : child process has process termination\n");
-		printk("[program2] : The return signal is %d\n",
-		       ((wopt.wo_stat) & 0x7f));
-		break;
+	/* later runs only differ in their per-child state */
+	for (i = ntargets; i < nruns; i++) {
+		targets[i].index = targets[i % ntargets].index;
+		targets[i].path = targets[i % ntargets].path;
+		targets[i].argv = targets[i % ntargets].argv;
 	}
 
-	default: {
-		// if (wo.wo_stat>>8==SIGSTOP){
-		if (wifstopped(wopt.wo_stat)) {
-			printk("[program2] : get SIGSTOP signal\n");
-			printk("[program2] : child process has stopped process execution\n");
-			printk("[program2] : The return signal is %d\n",
-			       SIGSTOP);
-		} else {
-			printk("[program2] : The return signal is %d\n",
-			       ((wopt.wo_stat) & 0x7f));
+	target_envp = default_envp;
+	if (nenv) {
+		target_envp = kcalloc(nenv + 1, sizeof(char *), GFP_KERNEL);
+		if (!target_envp) {
+			ret = -ENOMEM;
+			goto fail;
 		}
+		for (i = 0; i < nenv; i++)
+			target_envp[i] = env[i];
 	}
-}
-	put_pid(wo_pid_ptr);
+	return 0;
 
-	return;
+fail:
+	p2_free_targets();
+	return ret;
 }
 
 static int __init program2_init(void)
 {
+	struct task_struct *task;
+	int i, ret;
+
 	printk("[program2] : module_init\n");
+	ret = ring_alloc();
+	if (ret)
+		return ret;
+	ret = misc_register(&p2_dev);
+	if (ret)
+		goto free_ring;
+	ret = p2_proc_init();
+	if (ret)
+		goto deregister_dev;
+	ret = p2_setup_batch();
+	if (ret)
+		goto remove_proc;
+
+	max_inflight = max(max_inflight, 1);
+	nworkers = clamp(max_workers, 1, nruns);
+	workers = kcalloc(nworkers, sizeof(*workers), GFP_KERNEL);
+	if (!workers) {
+		ret = -ENOMEM;
+		p2_free_targets();
+		goto remove_proc;
+	}
+	atomic_set(&live_workers, nworkers);
 	printk("[program2] : module_init create kthread start\n");
 
-	//create a kthread
-	struct task_struct *task = kthread_run(&my_fork, NULL, "MyThread");
+	/* create kernel threads to run my_fork for every target */
+	for (i = 0; i < nworkers; i++) {
+		task = kthread_create(p2_worker, &workers[i], "program2/%d", i);
+		if (IS_ERR(task)) {
+			printk("[program2] : worker %d failed to start\n", i);
+			/* the running workers still drain the whole batch */
+			atomic_sub(nworkers - i, &live_workers);
+			break;
+		}
+		/* exit wakes the workers, which may have finished by then */
+		get_task_struct(task);
+		workers[i].task = task;
+		wake_up_process(task);
+	}
+	nworkers = i;
+	if (i == 0) {
+		ret = PTR_ERR(task);
+		kfree(workers);
+		p2_free_targets();
+		goto remove_proc;
+	}
 	printk("[program2] : module_init kthread start\n");
-	/* write your code here */
-
-	/* create a kernel thread to run my_fork */
 
 	return 0;
+
+remove_proc:
+	proc_remove(p2_proc_dir);
+deregister_dev:
+	misc_deregister(&p2_dev);
+free_ring:
+	vfree(ring);
+	return ret;
 }
 
 static void __exit program2_exit(void)
 {
+	int i;
+
+	/* no new targets; running children are killed and reaped */
+	WRITE_ONCE(stopping, true);
+	for (i = 0; i < nworkers; i++)
+		wake_up_process(workers[i].task);
+	/* every worker completes once, on its way out */
+	for (i = 0; i < nworkers; i++)
+		wait_for_completion(&workers_done);
+	for (i = 0; i < nworkers; i++)
+		put_task_struct(workers[i].task);
+	kfree(workers);
+	p2_free_targets();
+	/* open files pin the module, so no reader is left */
+	proc_remove(p2_proc_dir);
+	misc_deregister(&p2_dev);
+	vfree(ring);
 	printk("[program2] : module_exit\n");
 }
 
 module_init(program2_init);
-module_exit(program2_exit);
\ No newline at end of file
+module_exit(program2_exit);
@@ -0,0 +1,46 @@
+#ifndef PROGRAM2_RING_H
+#define PROGRAM2_RING_H
+
+#include <linux/types.h>
+
+/*
+ * Result ring of /dev/program2, shared by the module and its readers.
+ *
+ * mmap() of the device maps a header page followed by nr_records fixed
+ * size records. The module is the only writer of head and publishes a
+ * record by storing head with release semantics; the single reader
+ * consumes records from tail up to head and then stores tail the same way.
+ * When the ring is full new records are dropped and counted in lost.
+ * read() consumes the same ring for readers that do not map it.
+ */
+
+#define P2_RING_VERSION 1
+
+struct p2_ring_header {
+	__u32 version;		/* P2_RING_VERSION */
+	__u32 record_size;	/* sizeof(struct p2_record) */
+	__u32 nr_records;	/* power of two */
+	__u32 data_offset;	/* of record 0 from the start of the mapping */
+	__u64 head;		/* next record to be written */
+	__u64 tail;		/* next record to be consumed */
+	__u64 lost;
+};
+
+struct p2_record {
+	__u64 seq;		/* position in the ring, gaps mean lost records */
+	__s32 pid;
+	__s32 status;		/* raw wait status */
+	__s32 exit_code;	/* valid if exited */
+	__s32 signo;		/* terminating or stopping signal */
+	__u8 exited;
+	__u8 signaled;
+	__u8 stopped;
+	__u8 core_dumped;
+	__u32 target;		/* index into the paths parameter */
+	__u64 start_ns;		/* CLOCK_MONOTONIC before the clone */
+	__u64 end_ns;		/* CLOCK_MONOTONIC after the wait */
+	__u64 utime_ns;
+	__u64 stime_ns;
+};
+
+#endif
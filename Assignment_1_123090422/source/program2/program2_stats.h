@@ -0,0 +1,51 @@
+#ifndef PROGRAM2_STATS_H
+#define PROGRAM2_STATS_H
+
+#include <linux/types.h>
+
+/*
+ * Counters of the program2 launcher, exported as text in
+ * /proc/program2/stats and as one struct p2_stats in /proc/program2/stats.bin.
+ *
+ * The module keeps a copy per CPU and sums them when the files are read,
+ * so updates are plain per-CPU adds. The text format is one record per line:
+ *   version <n>
+ *   counter <name> <value>
+ *   signal <signo> <children ended or stopped by it>
+ *   phase <name> count <n> sum_ns <ns>
+ *   hist <phase> <bucket lower bound in ns> <count>   (non-empty buckets)
+ */
+
+#define P2_STATS_VERSION 1
+
+enum p2_phase {
+	P2_PHASE_CLONE,		/* kernel_clone() in the worker */
+	P2_PHASE_EXEC,		/* kernel_execve() in the child */
+	P2_PHASE_WAIT,		/* from the clone until the child is reaped */
+	P2_NR_PHASES,
+};
+
+/* bucket b counts latencies in [2^b, 2^(b+1)) ns, bucket 0 also counts 0 */
+#define P2_HIST_BUCKETS 48
+#define P2_NSIG 65
+
+struct p2_stats {
+	__u32 version;		/* P2_STATS_VERSION */
+	__u32 size;		/* sizeof(struct p2_stats) */
+	__u64 clones;
+	__u64 clone_failures;
+	__u64 execs;
+	__u64 exec_failures;
+	__u64 waits;
+	__u64 exited;
+	__u64 exited_nonzero;
+	__u64 signaled;
+	__u64 stopped;
+	__u64 core_dumped;
+	__u64 signals[P2_NSIG];
+	__u64 phase_count[P2_NR_PHASES];
+	__u64 phase_sum_ns[P2_NR_PHASES];
+	__u64 hist[P2_NR_PHASES][P2_HIST_BUCKETS];
+};
+
+#endif
@@ -0,0 +1,100 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM program2
+
+#if !defined(_PROGRAM2_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _PROGRAM2_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * Phase boundaries of the launcher, e.g.
+ *   perf record -e 'program2:*' -a
+ *   trace-cmd record -e program2
+ * trace_report.py turns the output into per-phase latencies. Targets are
+ * identified by their index in the paths parameter.
+ */
+
+TRACE_EVENT(program2_clone_start,
+	TP_PROTO(int target, const char *path),
+	TP_ARGS(target, path),
+	TP_STRUCT__entry(
+		__field(int, target)
+		__string(path, path)
+	),
+	TP_fast_assign(
+		__entry->target = target;
+		__assign_str(path, path);
+	),
+	TP_printk("target=%d path=%s", __entry->target, __get_str(path))
+);
+
+/* pid is the child's pid, or the negative errno of a failed clone */
+TRACE_EVENT(program2_clone_finish,
+	TP_PROTO(int target, pid_t pid),
+	TP_ARGS(target, pid),
+	TP_STRUCT__entry(
+		__field(int, target)
+		__field(pid_t, pid)
+	),
+	TP_fast_assign(
+		__entry->target = target;
+		__entry->pid = pid;
+	),
+	TP_printk("target=%d pid=%d", __entry->target, __entry->pid)
+);
+
+/* emitted by the child itself, so the event's task is the new process */
+TRACE_EVENT(program2_exec_start,
+	TP_PROTO(int target, const char *path),
+	TP_ARGS(target, path),
+	TP_STRUCT__entry(
+		__field(int, target)
+		__string(path, path)
+	),
+	TP_fast_assign(
+		__entry->target = target;
+		__assign_str(path, path);
+	),
+	TP_printk("target=%d path=%s", __entry->target, __get_str(path))
+);
+
+TRACE_EVENT(program2_exec_result,
+	TP_PROTO(int target, int ret),
+	TP_ARGS(target, ret),
+	TP_STRUCT__entry(
+		__field(int, target)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->target = target;
+		__entry->ret = ret;
+	),
+	TP_printk("target=%d ret=%d", __entry->target, __entry->ret)
+);
+
+/* one per reaped state change; a stop is followed by the final exit */
+TRACE_EVENT(program2_wait_result,
+	TP_PROTO(int target, pid_t pid, int status),
+	TP_ARGS(target, pid, status),
+	TP_STRUCT__entry(
+		__field(int, target)
+		__field(pid_t, pid)
+		__field(int, status)
+	),
+	TP_fast_assign(
+		__entry->target = target;
+		__entry->pid = pid;
+		__entry->status = status;
+	),
+	TP_printk("target=%d pid=%d status=0x%x", __entry->target,
+		  __entry->pid, __entry->status)
+);
+
+#endif /* _PROGRAM2_TRACE_H */
+
+/* out of tree: look for this header next to program2.c */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE program2_trace
+#include <trace/define_trace.h>
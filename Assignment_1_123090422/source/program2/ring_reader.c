@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+
+#include "program2_ring.h"
+#include "../common/sigtab.h"
+
+/*
+ * Consume program2 results straight from the mapped ring:
+ *   ./ring_reader [-n count] [/dev/program2]
+ * Prints one line per record and stops after count records (default: run
+ * until interrupted).
+ */
+
+static void print_record(const struct p2_record *rec)
+{
+	printf("%llu target %u pid %d ", (unsigned long long)rec->seq,
+	       rec->target, rec->pid);
+	if (rec->exited)
+		printf("exited %d", rec->exit_code);
+	else if (rec->stopped)
+		printf("stopped by %s", sigtab_name(rec->signo));
+	else
+		printf("killed by %s%s", sigtab_name(rec->signo),
+		       rec->core_dumped ? " (core dumped)" : "");
+	printf(", wall %.3fms, user %.3fms, sys %.3fms\n",
+	       (rec->end_ns - rec->start_ns) / 1e6, rec->utime_ns / 1e6,
+	       rec->stime_ns / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dev = "/dev/program2";
+	volatile struct p2_ring_header *hdr;
+	const struct p2_record *data;
+	long count = -1, seen = 0;
+	size_t size;
+	void *map;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n count] [device]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (optind < argc)
+		dev = argv[optind];
+
+	fd = open(dev, O_RDWR);
+	if (fd < 0) {
+		perror(dev);
+		return 1;
+	}
+	/* the header says how large the whole mapping is */
+	map = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	hdr = map;
+	if (hdr->version != P2_RING_VERSION ||
+	    hdr->record_size != sizeof(struct p2_record)) {
+		fprintf(stderr, "%s: ring version %u, record size %u not "
+			"supported\n", dev, hdr->version, hdr->record_size);
+		return 1;
+	}
+	size = hdr->data_offset + (size_t)hdr->nr_records * hdr->record_size;
+	munmap(map, sysconf(_SC_PAGESIZE));
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	hdr = map;
+	data = (const struct p2_record *)((char *)map + hdr->data_offset);
+
+	while (count < 0 || seen < count) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		__u64 head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+		__u64 tail = hdr->tail;
+
+		if (head == tail) {
+			if (poll(&pfd, 1, -1) < 0) {
+				perror("poll");
+				return 1;
+			}
+			continue;
+		}
+		for (; tail != head && (count < 0 || seen < count); tail++) {
+			print_record(&data[tail & (hdr->nr_records - 1)]);
+			seen++;
+		}
+		/* hand the slots back only after they have been read */
+		__atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+		fflush(stdout);
+	}
+	if (hdr->lost)
+		fprintf(stderr, "%llu records lost\n",
+			(unsigned long long)hdr->lost);
+	return 0;
+}
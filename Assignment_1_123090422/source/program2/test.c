@@ -5,11 +5,18 @@
 int main(int argc,char* argv[]){
 	int i=0;
 
+#ifdef FAST
+	static const char msg[] = "--------USER PROGRAM--------\n";
+
+	write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+	raise(SIGBUS);
+#else
 	printf("--------USER PROGRAM--------\n");
 //	alarm(2);
 	raise(SIGBUS);
 	sleep(5);
 	printf("user process success!!\n");
 	printf("--------USER PROGRAM--------\n");
+#endif
 	return 100;
 }
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Per-phase latency report from program2 trace events.
+
+Reads the text output of any of
+    cat /sys/kernel/tracing/trace
+    trace-cmd report
+    perf script
+from a file or stdin, pairs the program2:* events and prints count, min,
+percentiles and max for each phase:
+
+    clone    program2_clone_start -> program2_clone_finish (worker)
+    start    program2_clone_finish -> program2_exec_start (child first runs)
+    exec     program2_exec_start -> program2_exec_result (child)
+    lifetime program2_clone_finish -> final program2_wait_result
+"""
+
+import re
+import sys
+
+# "<comm>-<tid> [cpu] ... <ts>: <event>: <args>" (ftrace, trace-cmd) or
+# "<comm> <tid> [cpu] <ts>: program2:<event>: <args>" (perf script)
+LINE = re.compile(r'[-\s](?P<tid>\d+)\s+(?:\(\s*\d+\)\s+)?\[\d+\].*?'
+                  r'(?P<ts>\d+\.\d+):\s+(?:program2:)?'
+                  r'(?P<event>program2_\w+):\s*(?P<args>.*)$')
+ARG = re.compile(r'(\w+)=(\S+)')
+
+PHASES = ('clone', 'start', 'exec', 'lifetime')
+
+
+def parse(lines):
+    for line in lines:
+        m = LINE.search(line)
+        if not m:
+            continue
+        args = {k: v for k, v in ARG.findall(m.group('args'))}
+        yield (int(m.group('tid')), float(m.group('ts')), m.group('event'),
+               args)
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def main():
+    src = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    lat = {phase: [] for phase in PHASES}
+    clone_start = {}    # (worker tid, target) -> ts
+    cloned = {}         # child pid -> ts
+    exec_start = {}     # child pid -> ts
+    failures = {'clone': 0, 'exec': 0}
+
+    for tid, ts, event, args in parse(src):
+        target = args.get('target')
+        if event == 'program2_clone_start':
+            clone_start[(tid, target)] = ts
+        elif event == 'program2_clone_finish':
+            start = clone_start.pop((tid, target), None)
+            if start is not None:
+                lat['clone'].append(ts - start)
+            pid = int(args['pid'])
+            if pid < 0:
+                failures['clone'] += 1
+            else:
+                cloned[pid] = ts
+        elif event == 'program2_exec_start':
+            if tid in cloned:
+                lat['start'].append(ts - cloned[tid])
+            exec_start[tid] = ts
+        elif event == 'program2_exec_result':
+            start = exec_start.pop(tid, None)
+            if start is not None:
+                lat['exec'].append(ts - start)
+            if int(args['ret']) != 0:
+                failures['exec'] += 1
+        elif event == 'program2_wait_result':
+            pid = int(args['pid'])
+            # a stop is reported before the final exit
+            if int(args['status'], 16) & 0xff == 0x7f:
+                continue
+            start = cloned.pop(pid, None)
+            if start is not None:
+                lat['lifetime'].append(ts - start)
+
+    print('%-9s %8s %10s %10s %10s %10s %10s' %
+          ('phase', 'count', 'min_us', 'p50_us', 'p90_us', 'p99_us',
+           'max_us'))
+    for phase in PHASES:
+        values = sorted(v * 1e6 for v in lat[phase])
+        if not values:
+            print('%-9s %8d' % (phase, 0))
+            continue
+        print('%-9s %8d %10.1f %10.1f %10.1f %10.1f %10.1f' %
+              (phase, len(values), values[0], percentile(values, 0.5),
+               percentile(values, 0.9), percentile(values, 0.99),
+               values[-1]))
+    if failures['clone'] or failures['exec']:
+        print('failed: %d clones, %d execs' %
+              (failures['clone'], failures['exec']))
+    if cloned:
+        print('%d children without a final wait_result' % len(cloned))
+
+
+if __name__ == '__main__':
+    main()
@@ -7,6 +7,12 @@
 #include <termios.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <stdint.h>
 
 /* const numbers define */
 #define ROW 17
@@ -24,9 +30,35 @@ int player_x;
 int player_y;
 char map_data[ROW][COLUMN + 1];
 
+/* renderer state: what the terminal currently shows and the frame being
+ * assembled. A frame is at most a clear, a cursor move per cell and the
+ * cells themselves. */
+#define RUN_GAP 6
+char screen_front[ROW][COLUMN];
+int screen_valid = 0;                 // 0: next frame redraws everything
+char frame_buf[16 + ROW * COLUMN * 10];
+
+/* triple buffer between the simulation and the render thread. The
+ * simulation fills snaps[snap_write] and swaps it into snap_ready; the
+ * renderer swaps snap_ready with snaps[snap_read] when SNAP_FRESH is set.
+ * Neither side waits on the other and a published frame is never written
+ * again until the renderer has given it back. */
+#define SNAP_FRESH 4
+#define FRAME_INTERVAL (16 * 1000)   // 16 ms, about 60 frames per second
+char snaps[3][ROW][COLUMN + 1];
+int snap_write = 0;                  // owned by whoever holds map_mutex
+int snap_ready = 1;                  // shared, index | SNAP_FRESH
+int snap_read = 2;                   // owned by the render thread
+volatile int render_stop = 0;
+
 pthread_mutex_t map_mutex = PTHREAD_MUTEX_INITIALIZER;
 volatile int running = 1;    // 1: running, 0: stop
 volatile int game_over = 0;  // 0: playing, 1: lose, 2: win, 3: quit
+int stop_fd = -1;            // eventfd, wakes the input thread at game end
+
+/* terminal state saved by term_setup() */
+struct termios term_orig;
+int term_saved = 0;           // 1: term_orig holds the tty settings
 
 /* walls and gold structures */
 typedef struct {
@@ -48,45 +80,209 @@ typedef struct {
 Wall walls[WALL_COUNT];
 Gold golds[GOLD_COUNT];
 
+/* headless engine: the game is a pure function of the seed and the
+ * timestamped keys fed to game_key(), on a simulated clock that starts
+ * at 0. Nothing below game_init()/game_advance()/game_key() touches the
+ * terminal or the real clock, so a game can be replayed bit-exactly. */
+uint64_t rng_state;
+int64_t sim_ns = 0;          // simulated time reached so far
+int headless = 0;            // 1: map_publish() hands out no frames
+
+typedef struct {
+    int64_t t_ns;
+    int key;
+} Event;
+
+Event *rec_events = NULL;    // keys applied so far, for the replay file
+size_t rec_len = 0;
+size_t rec_cap = 0;
+
+/* tick classes: every object class moves on its own fixed period */
+typedef struct {
+    const char *name;
+    int64_t period_ns;
+    void (*step)(void);
+    int64_t next_ns;        // next deadline on the simulated clock
+    unsigned long ticks;    // deadlines served
+    unsigned long overruns; // served a period or more late
+    int64_t late_sum_ns;
+    int64_t late_max_ns;
+} TickClass;
+
+void step_walls(void);
+void step_golds(void);
+
+// wall speed: want wall fully cross in ~10s
+TickClass ticks[] = {
+    { "walls", 200 * 1000000LL, step_walls, 0, 0, 0, 0, 0 },
+    { "golds", 220 * 1000000LL, step_golds, 0, 0, 0, 0, 0 },
+};
+#define TICK_CLASSES (int)(sizeof(ticks) / sizeof(ticks[0]))
+
 /* functions */
-int kbhit(void);
-void map_print(void);
+void term_setup(void);
+void term_restore(void);
+int handle_key(int ch);
+int check_collisions(void);
+void tick_report(void);
+void game_init(uint64_t seed);
+int game_advance(int64_t t_ns);
+int game_key(int64_t t_ns, int ch);
+uint64_t game_hash(void);
+int64_t game_clock(void);
+void map_print(const char cells[ROW][COLUMN + 1]);
+void map_publish(void);
 void rebuild_map(void);
 void *input_thread_fn(void *arg);
 void *move_thread_fn(void *arg);
+void *render_thread_fn(void *arg);
 void end_screen(int reason); // 1 lose, 2 win, 3 quit
 
-/* Determine a keyboard is hit or not.
- * If yes, return 1. If not, return 0. */
-int kbhit(void)
-{
-    struct termios oldt, newt;
-    int ch;
-    int oldf;
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    oldf = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, oldf | O_NONBLOCK);
-    ch = getchar();
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-    fcntl(STDIN_FILENO, F_SETFL, oldf);
-    if (ch != EOF)
-    {
-        ungetc(ch, stdin);
-        return 1;
+/* put back the terminal settings saved by term_setup() */
+void term_restore(void)
+{
+    if (term_saved)
+        tcsetattr(STDIN_FILENO, TCSANOW, &term_orig);
+}
+
+/* restore the terminal on fatal signals, then die of the signal as usual */
+static void term_signal(int sig)
+{
+    term_restore();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/* switch stdin to non-canonical, no-echo mode once for the whole game;
+ * it is restored at exit and on SIGINT/SIGTERM/SIGHUP/SIGQUIT. The fd
+ * stays blocking: it usually shares its file description with stdout,
+ * and the input thread only reads after poll() says a key is there. */
+void term_setup(void)
+{
+    if (tcgetattr(STDIN_FILENO, &term_orig) == 0) {
+        struct termios raw = term_orig;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        term_saved = 1;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+    atexit(term_restore);
+    signal(SIGINT, term_signal);
+    signal(SIGTERM, term_signal);
+    signal(SIGHUP, term_signal);
+    signal(SIGQUIT, term_signal);
+}
+
+/* append a cursor move to (row, col), both 0-based */
+static size_t frame_goto(char *out, int row, int col)
+{
+    return sprintf(out, "\033[%d;%dH", row + 1, col + 1);
+}
+
+/* write the whole frame, retrying short writes and waiting for room
+ * if stdout is non-blocking. Returns -1 if part of it was lost. */
+static int frame_write(const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                struct pollfd pfd;
+                pfd.fd = STDOUT_FILENO;
+                pfd.events = POLLOUT;
+                if (poll(&pfd, 1, -1) < 0 && errno != EINTR) return -1;
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
     }
     return 0;
 }
 
-/* print the map */
-void map_print(void)
+/* print a snapshot of the map: cells is the back buffer, screen_front
+ * what the terminal shows. Only runs of changed cells are sent, each after
+ * a cursor move, and the frame goes out in a single write(). Called from
+ * the render thread only. */
+void map_print(const char cells[ROW][COLUMN + 1])
 {
-    printf("\033[H\033[2J");
-    int i;
-    for (i = 0; i <= ROW - 1; i++)
-        puts(map_data[i]);
+    char *out = frame_buf;
+    int i, j;
+
+    if (!screen_valid) {
+        // first frame: clear once and fall through to a full diff
+        out += sprintf(out, "\033[H\033[2J");
+        for (i = 0; i < ROW; i++)
+            memset(screen_front[i], 0, COLUMN);
+        screen_valid = 1;
+    }
+    for (i = 0; i < ROW; i++) {
+        j = 0;
+        while (j < COLUMN) {
+            if (cells[i][j] == screen_front[i][j]) {
+                j++;
+                continue;
+            }
+            // extend the run over short unchanged gaps, resending a few
+            // cells is cheaper than another cursor move
+            int end = j + 1, k = j + 1;
+            while (k < COLUMN && k - end <= RUN_GAP) {
+                if (cells[i][k] != screen_front[i][k]) end = k + 1;
+                k++;
+            }
+            out += frame_goto(out, i, j);
+            memcpy(out, &cells[i][j], end - j);
+            memcpy(&screen_front[i][j], &cells[i][j], end - j);
+            out += end - j;
+            j = end;
+        }
+    }
+    if (out == frame_buf) return;
+    // park the cursor under the map so the end screen starts clean
+    out += frame_goto(out, ROW, 0);
+    if (frame_write(frame_buf, out - frame_buf) < 0) {
+        // the terminal may show anything now; redraw every cell next time
+        for (i = 0; i < ROW; i++)
+            memset(screen_front[i], 0, COLUMN);
+    }
+}
+
+/* hand the current map_data to the renderer; call with map_mutex held */
+void map_publish(void)
+{
+    if (headless) return;
+    memcpy(snaps[snap_write], map_data, sizeof(map_data));
+    snap_write = __atomic_exchange_n(&snap_ready, snap_write | SNAP_FRESH,
+                                     __ATOMIC_ACQ_REL) & ~SNAP_FRESH;
+}
+
+/* take the newest published frame, if any, into snaps[snap_read] */
+static int snapshot_take(void)
+{
+    if (!(__atomic_load_n(&snap_ready, __ATOMIC_ACQUIRE) & SNAP_FRESH))
+        return 0;
+    snap_read = __atomic_exchange_n(&snap_ready, snap_read,
+                                    __ATOMIC_ACQ_REL) & ~SNAP_FRESH;
+    return 1;
+}
+
+/* render thread: draw the newest snapshot once per frame interval, so
+ * terminal writes never happen under map_mutex */
+void *render_thread_fn(void *arg)
+{
+    (void)arg;
+    while (!render_stop) {
+        if (snapshot_take())
+            map_print(snaps[snap_read]);
+        usleep(FRAME_INTERVAL);
+    }
+    // the final frame (the losing or winning move) before the end screen
+    if (snapshot_take())
+        map_print(snaps[snap_read]);
+    return NULL;
 }
 
 /* rebuild the map_data from current objects */
@@ -139,212 +335,204 @@ void rebuild_map(void)
         map_data[player_x][player_y] = PLAYER;
 }
 
-/* input thread: read keys and move player */
-void *input_thread_fn(void *arg)
+/* apply one key to the game; call with map_mutex held.
+ * Returns 1 when the key ended the game. */
+int handle_key(int ch)
 {
-    (void)arg;
-    while (running && !game_over) {
-        if (kbhit()) {
-            int ch = getchar();
-            if (ch == EOF) continue;
-            ch = tolower(ch);
-            pthread_mutex_lock(&map_mutex);
-            if (ch == 'q') {
-                game_over = 3; // quit
+    ch = tolower(ch);
+    if (ch == 'q') {
+        game_over = 3; // quit
+        running = 0;
+        return 1;
+    } else if (ch == 'w' || ch == 's' || ch == 'a' || ch == 'd') {
+        int nx = player_x;
+        int ny = player_y;
+        if (ch == 'w') nx = player_x - 1;
+        if (ch == 's') nx = player_x + 1;
+        if (ch == 'a') ny = player_y - 1;
+        if (ch == 'd') ny = player_y + 1;
+
+        // can't go to border or beyond
+        if (nx <= 0 || nx >= ROW-1 || ny <= 0 || ny >= COLUMN-1) {
+            // ignore move
+        } else {
+            // check if stepping onto wall -> lose
+            if (map_data[nx][ny] == WALL_CHAR) {
+                player_x = nx; player_y = ny;
+                rebuild_map();
+                map_publish();
+                game_over = 1; // lose
                 running = 0;
-                pthread_mutex_unlock(&map_mutex);
-                break;
-            } else if (ch == 'w' || ch == 's' || ch == 'a' || ch == 'd') {
-                int nx = player_x;
-                int ny = player_y;
-                if (ch == 'w') nx = player_x - 1;
-                if (ch == 's') nx = player_x + 1;
-                if (ch == 'a') ny = player_y - 1;
-                if (ch == 'd') ny = player_y + 1;
-
-                // can't go to border or beyond
-                if (nx <= 0 || nx >= ROW-1 || ny <= 0 || ny >= COLUMN-1) {
-                    // ignore move
-                } else {
-                    // check if stepping onto wall -> lose
-                    if (map_data[nx][ny] == WALL_CHAR) {
-                        player_x = nx; player_y = ny;
-                        rebuild_map();
-                        map_print();
-                        game_over = 1; // lose
-                        running = 0;
-                        pthread_mutex_unlock(&map_mutex);
-                        break;
-                    }
-                    // check if stepping on gold -> collect
-                    if (map_data[nx][ny] == GOLD_CHAR) {
-                        // find and mark gold dead
-                        for (int i = 0; i < GOLD_COUNT; i++) {
-                            if (golds[i].alive && golds[i].row == nx && golds[i].col == ny) {
-                                golds[i].alive = 0;
-                                break;
-                            }
-                        }
-                    }
-                    player_x = nx; player_y = ny;
-                    // check win
-                    int remaining = 0;
-                    for (int i = 0; i < GOLD_COUNT; i++) if (golds[i].alive) remaining++;
-                    if (remaining == 0) {
-                        rebuild_map();
-                        map_print();
-                        game_over = 2; // win
-                        running = 0;
-                        pthread_mutex_unlock(&map_mutex);
+                return 1;
+            }
+            // check if stepping on gold -> collect
+            if (map_data[nx][ny] == GOLD_CHAR) {
+                // find and mark gold dead
+                for (int i = 0; i < GOLD_COUNT; i++) {
+                    if (golds[i].alive && golds[i].row == nx && golds[i].col == ny) {
+                        golds[i].alive = 0;
                         break;
                     }
                 }
             }
-            // swallow any extra chars on line (ensure no stray prints)
-            // (we used non-echo mode locally in kbhit so typed chars won't show)
-            rebuild_map();
-            map_print();
-            pthread_mutex_unlock(&map_mutex);
+            player_x = nx; player_y = ny;
+            // check win
+            int remaining = 0;
+            for (int i = 0; i < GOLD_COUNT; i++) if (golds[i].alive) remaining++;
+            if (remaining == 0) {
+                rebuild_map();
+                map_publish();
+                game_over = 2; // win
+                running = 0;
+                return 1;
+            }
         }
-        usleep(50 * 1000);
     }
-    return NULL;
+    return 0;
 }
 
-/* movement thread: move walls and golds periodically */
-void *move_thread_fn(void *arg)
+/* input thread: sleep in poll() until keys or the stop event arrive, then
+ * apply every key read in one go under a single lock */
+void *input_thread_fn(void *arg)
 {
     (void)arg;
-    // wall speed: want wall fully cross in ~10s; approximate interval
-    const useconds_t wall_interval = 200 * 1000; // 200 ms
-    const useconds_t gold_interval = 220 * 1000; // 220 ms (slightly different)
-    useconds_t counters = 0;
+    struct pollfd fds[2];
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = stop_fd;
+    fds[1].events = POLLIN;
 
     while (running && !game_over) {
-        pthread_mutex_lock(&map_mutex);
-        // move walls every wall_interval
-        // move each wall by its dir
-        for (int i = 0; i < WALL_COUNT; i++) {
-            // update start col
-            int span = COLUMN - 2; // available columns (1..COLUMN-2)
-            int newstart = walls[i].col + walls[i].dir;
-            // wrap around in [1, span]
-            if (newstart < 1) newstart += span;
-            if (newstart > span) newstart -= span;
-            walls[i].col = newstart;
-        }
-
-        // move golds
-        for (int i = 0; i < GOLD_COUNT; i++) {
-            if (!golds[i].alive) continue;
-            int span = COLUMN - 2;
-            int newc = golds[i].col + golds[i].dir;
-            if (newc < 1) newc += span;
-            if (newc > span) newc -= span;
-            golds[i].col = newc;
-        }
-
-        // check if any wall occupies player -> lose
-        for (int i = 0; i < WALL_COUNT; i++) {
-            int r = walls[i].row;
-            for (int j = 0; j < WALL_LEN; j++) {
-                int pos = (walls[i].col - 1 + j) % (COLUMN - 2);
-                if (pos < 0) pos += (COLUMN - 2);
-                int c = 1 + pos;
-                if (r == player_x && c == player_y) {
-                    rebuild_map();
-                    map_print();
-                    game_over = 1; // lose
-                    running = 0;
-                    break;
-                }
-            }
-            if (game_over) break;
-        }
-        if (game_over) {
-            pthread_mutex_unlock(&map_mutex);
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
             break;
         }
-
-        // check if any gold moves onto player -> collect
-        for (int i = 0; i < GOLD_COUNT; i++) {
-            if (!golds[i].alive) continue;
-            if (golds[i].row == player_x && golds[i].col == player_y) {
-                golds[i].alive = 0;
-            }
+        if (fds[1].revents) break;
+        if (!fds[0].revents) continue;
+
+        char keys[64];
+        ssize_t n = read(STDIN_FILENO, keys, sizeof(keys));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            n = 0;
         }
-        // check remaining golds for win
-        int remaining = 0;
-        for (int i = 0; i < GOLD_COUNT; i++) if (golds[i].alive) remaining++;
-        if (remaining == 0) {
+        if (n == 0) {
+            // stdin closed: keep waiting for the stop event only
+            fds[0].fd = -1;
+            continue;
+        }
+        pthread_mutex_lock(&map_mutex);
+        int64_t t = game_clock();
+        int ended = 0;
+        for (ssize_t i = 0; i < n && !ended; i++)
+            ended = game_key(t, (unsigned char)keys[i]);
+        if (!ended) {
             rebuild_map();
-            map_print();
-            game_over = 2; // win
-            running = 0;
-            pthread_mutex_unlock(&map_mutex);
-            break;
+            map_publish();
         }
-
-        // redraw
-        rebuild_map();
-        map_print();
         pthread_mutex_unlock(&map_mutex);
-
-        // sleep
-        usleep(wall_interval);
+        if (ended) break;
     }
+    // wake the movement thread if the game ended here
+    eventfd_write(stop_fd, 1);
     return NULL;
 }
 
-void end_screen(int reason)
+/* move each wall by its dir, wrapping around in [1, COLUMN-2] */
+void step_walls(void)
 {
-    printf("\033[H\033[2J");
-    if (reason == 1) {
-        printf("You loss the game!!\n");
-    } else if (reason == 2) {
-        printf("You win the game!!\n");
-    } else if (reason == 3) {
-        printf("You exit the game.\n");
+    for (int i = 0; i < WALL_COUNT; i++) {
+        int span = COLUMN - 2; // available columns (1..COLUMN-2)
+        int newstart = walls[i].col + walls[i].dir;
+        if (newstart < 1) newstart += span;
+        if (newstart > span) newstart -= span;
+        walls[i].col = newstart;
     }
-    printf("\n");
 }
 
-int main(int argc, char *argv[])
+/* move each remaining gold by its dir */
+void step_golds(void)
 {
-    srand(time(NULL));
-    int i, j;
+    for (int i = 0; i < GOLD_COUNT; i++) {
+        if (!golds[i].alive) continue;
+        int span = COLUMN - 2;
+        int newc = golds[i].col + golds[i].dir;
+        if (newc < 1) newc += span;
+        if (newc > span) newc -= span;
+        golds[i].col = newc;
+    }
+}
 
-    /* initialize the map array */
-    for (i = 0; i < ROW; i++) {
-        for (j = 0; j < COLUMN; j++) map_data[i][j] = ' ';
-        map_data[i][COLUMN] = '\0';
+/* apply the collision rules after objects moved; call with map_mutex
+ * held. Returns 1 when the game ended. */
+int check_collisions(void)
+{
+    // check if any wall occupies player -> lose
+    for (int i = 0; i < WALL_COUNT; i++) {
+        int r = walls[i].row;
+        for (int j = 0; j < WALL_LEN; j++) {
+            int pos = (walls[i].col - 1 + j) % (COLUMN - 2);
+            if (pos < 0) pos += (COLUMN - 2);
+            int c = 1 + pos;
+            if (r == player_x && c == player_y) {
+                rebuild_map();
+                map_publish();
+                game_over = 1; // lose
+                running = 0;
+                return 1;
+            }
+        }
     }
 
-    // borders & interior
-    for (j = 1; j <= COLUMN - 2; j++) {
-        map_data[0][j] = HORI_LINE;
-        map_data[ROW - 1][j] = HORI_LINE;
+    // check if any gold moves onto player -> collect
+    for (int i = 0; i < GOLD_COUNT; i++) {
+        if (!golds[i].alive) continue;
+        if (golds[i].row == player_x && golds[i].col == player_y) {
+            golds[i].alive = 0;
+        }
     }
-    for (i = 1; i <= ROW - 2; i++) {
-        map_data[i][0] = VERT_LINE;
-        map_data[i][COLUMN - 1] = VERT_LINE;
+    // check remaining golds for win
+    int remaining = 0;
+    for (int i = 0; i < GOLD_COUNT; i++) if (golds[i].alive) remaining++;
+    if (remaining == 0) {
+        rebuild_map();
+        map_publish();
+        game_over = 2; // win
+        running = 0;
+        return 1;
     }
-    map_data[0][0] = CORNER;
-    map_data[0][COLUMN - 1] = CORNER;
-    map_data[ROW - 1][0] = CORNER;
-    map_data[ROW - 1][COLUMN - 1] = CORNER;
+    return 0;
+}
+
+/* xorshift64*; rng_state is the only source of randomness in the game */
+uint32_t rng_next(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (uint32_t)((*state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/* reset every piece of game state for a new game played with seed */
+void game_init(uint64_t seed)
+{
+    int i;
+    rng_state = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    sim_ns = 0;
+    game_over = 0;
+    running = 1;
+    rec_len = 0;
 
     /* initialize player */
     player_x = ROW / 2;
     player_y = COLUMN / 2;
-    map_data[player_x][player_y] = PLAYER;
 
     /* initialize walls */
     int wall_rows[WALL_COUNT] = {2,4,6,10,12,14};
     for (i = 0; i < WALL_COUNT; i++) {
         walls[i].row = wall_rows[i];
         // random starting col in [1, COLUMN-2]
-        walls[i].col = (rand() % (COLUMN - 2)) + 1;
+        walls[i].col = (rng_next(&rng_state) % (COLUMN - 2)) + 1;
         // directions: right, left, right, left...
         walls[i].dir = (i % 2 == 0) ? 1 : -1;
     }
@@ -353,28 +541,427 @@ int main(int argc, char *argv[])
     int gold_rows[GOLD_COUNT] = {1,3,5,11,13,15};
     for (i = 0; i < GOLD_COUNT; i++) {
         golds[i].row = gold_rows[i];
-        golds[i].col = (rand() % (COLUMN - 2)) + 1;
-        golds[i].dir = (rand() % 2 == 0) ? 1 : -1;
+        golds[i].col = (rng_next(&rng_state) % (COLUMN - 2)) + 1;
+        golds[i].dir = (rng_next(&rng_state) % 2 == 0) ? 1 : -1;
         golds[i].alive = 1;
     }
 
+    for (i = 0; i < TICK_CLASSES; i++) {
+        ticks[i].next_ns = ticks[i].period_ns;
+        ticks[i].ticks = ticks[i].overruns = 0;
+        ticks[i].late_sum_ns = ticks[i].late_max_ns = 0;
+    }
     rebuild_map();
-    map_print();
+}
+
+/* run the simulation up to time t_ns: deadlines are served one at a time
+ * in time order (ties in ticks[] order) with the collision rules after
+ * each step, so the result does not depend on how the time is split into
+ * calls. Every served deadline counts as a tick of its class with its
+ * lateness (t_ns - deadline) as jitter, and as an overrun when served a
+ * whole period or more late. The stats are not part of the game state.
+ * Returns the number of steps taken. */
+int game_advance(int64_t t_ns)
+{
+    int steps = 0;
+    t_ns -= t_ns % 1000; // the replay file keeps microseconds
+    while (!game_over) {
+        TickClass *due = NULL;
+        for (int i = 0; i < TICK_CLASSES; i++)
+            if (ticks[i].next_ns <= t_ns &&
+                (!due || ticks[i].next_ns < due->next_ns))
+                due = &ticks[i];
+        if (!due) break;
+        // how late this deadline is served; only real time in a live game
+        int64_t late = t_ns - due->next_ns;
+        due->ticks++;
+        due->late_sum_ns += late;
+        if (late > due->late_max_ns) due->late_max_ns = late;
+        if (late >= due->period_ns) due->overruns++;
+        sim_ns = due->next_ns;
+        due->next_ns += due->period_ns;
+        due->step();
+        steps++;
+        if (check_collisions()) return steps;
+    }
+    if (game_over) return steps;
+    if (t_ns > sim_ns) sim_ns = t_ns;
+    if (steps) rebuild_map();
+    return steps;
+}
+
+/* apply a key pressed at t_ns (rounded down to the microsecond like
+ * game_advance()). Returns 1 when the game is over. */
+int game_key(int64_t t_ns, int ch)
+{
+    t_ns -= t_ns % 1000;
+    game_advance(t_ns);
+    if (game_over) return 1;
+    if (ch == 0) return 0; // NUL ends a record in the replay file
+    if (rec_len == rec_cap) {
+        rec_cap = rec_cap ? rec_cap * 2 : 256;
+        rec_events = (Event *)realloc(rec_events, rec_cap * sizeof(Event));
+    }
+    rec_events[rec_len].t_ns = t_ns;
+    rec_events[rec_len].key = ch;
+    rec_len++;
+    return handle_key(ch);
+}
+
+/* FNV-1a over everything that decides how the game continues */
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    while (len--) {
+        h ^= *p++;
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+uint64_t game_hash(void)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    int over = game_over;
+    h = fnv1a(h, &player_x, sizeof(player_x));
+    h = fnv1a(h, &player_y, sizeof(player_y));
+    h = fnv1a(h, walls, sizeof(walls));
+    h = fnv1a(h, golds, sizeof(golds));
+    h = fnv1a(h, &over, sizeof(over));
+    h = fnv1a(h, &sim_ns, sizeof(sim_ns));
+    h = fnv1a(h, &rng_state, sizeof(rng_state));
+    for (int i = 0; i < TICK_CLASSES; i++)
+        h = fnv1a(h, &ticks[i].next_ns, sizeof(ticks[i].next_ns));
+    return h;
+}
+
+static int64_t ts_ns(const struct timespec *ts)
+{
+    return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+/* CLOCK_MONOTONIC time of game_init() in a live game */
+int64_t game_start_ns;
+
+/* the simulated clock of a live game: real time since the start */
+int64_t game_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ts_ns(&now) - game_start_ns;
+}
+
+/* movement thread: one absolute-time loop drives every tick class. The
+ * timerfd is armed for the earliest deadline and game_advance() serves
+ * every deadline that has passed, so the game keeps its speed when a
+ * wakeup is late. */
+void *move_thread_fn(void *arg)
+{
+    (void)arg;
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    struct pollfd fds[2];
+    fds[0].fd = tfd;
+    fds[0].events = POLLIN;
+    fds[1].fd = stop_fd;
+    fds[1].events = POLLIN;
+
+    while (running && !game_over) {
+        pthread_mutex_lock(&map_mutex);
+        int64_t deadline = ticks[0].next_ns;
+        for (int i = 1; i < TICK_CLASSES; i++)
+            if (ticks[i].next_ns < deadline) deadline = ticks[i].next_ns;
+        pthread_mutex_unlock(&map_mutex);
+        deadline += game_start_ns;
+        struct itimerspec its;
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = deadline / 1000000000;
+        its.it_value.tv_nsec = deadline % 1000000000;
+        timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        if (!fds[0].revents) continue;
+        uint64_t expirations;
+        if (read(tfd, &expirations, sizeof(expirations)) < 0) continue;
+
+        pthread_mutex_lock(&map_mutex);
+        if (game_advance(game_clock()) && !game_over)
+            map_publish();
+        pthread_mutex_unlock(&map_mutex);
+    }
+    close(tfd);
+    // the game is over either way; wake the input thread out of poll()
+    eventfd_write(stop_fd, 1);
+    return NULL;
+}
+
+/* print how well each tick class kept its period */
+void tick_report(void)
+{
+    for (int i = 0; i < TICK_CLASSES; i++) {
+        const TickClass *t = &ticks[i];
+        printf("%-6s period %3lld ms: %lu ticks, jitter avg %.3f ms max %.3f ms, "
+               "%lu overruns\n", t->name, (long long)t->period_ns / 1000000,
+               t->ticks, t->ticks ? t->late_sum_ns / 1e6 / t->ticks : 0.0,
+               t->late_max_ns / 1e6, t->overruns);
+    }
+}
+
+/* replay file: a header, one record per key and an end record
+ *   header  "HW2R", uint32 version, uint64 seed
+ *   key     varint microseconds since the previous record, key byte
+ *   end     varint microseconds to the end of the game, 0,
+ *           uint8 game_over, uint64 game_hash()
+ * Fixed-size integers are little-endian, varints are LEB128. */
+#define REPLAY_MAGIC "HW2R"
+#define REPLAY_VERSION 1
+#define BENCH_LIMIT_NS (600 * 1000000000LL) // give up on a game after 10 min
+
+static void put_le(FILE *f, uint64_t v, int bytes)
+{
+    while (bytes--) {
+        fputc((int)(v & 0xff), f);
+        v >>= 8;
+    }
+}
+
+static void put_varint(FILE *f, uint64_t v)
+{
+    while (v >= 0x80) {
+        fputc((int)(v & 0x7f) | 0x80, f);
+        v >>= 7;
+    }
+    fputc((int)v, f);
+}
+
+/* write the game just played (seed, rec_events, final state) to path */
+int replay_write(const char *path, uint64_t seed)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+    int64_t last_us = 0;
+    fwrite(REPLAY_MAGIC, 1, 4, f);
+    put_le(f, REPLAY_VERSION, 4);
+    put_le(f, seed, 8);
+    for (size_t i = 0; i < rec_len; i++) {
+        int64_t us = rec_events[i].t_ns / 1000;
+        put_varint(f, us - last_us);
+        fputc(rec_events[i].key, f);
+        last_us = us;
+    }
+    put_varint(f, sim_ns / 1000 - last_us);
+    fputc(0, f);
+    fputc(game_over, f);
+    put_le(f, game_hash(), 8);
+    if (fclose(f) != 0) return -1;
+    return 0;
+}
+
+/* replay seed and a key stream on the headless engine, then run on to
+ * end_ns; the state is left for the caller to inspect */
+void game_replay(uint64_t seed, const Event *ev, size_t n, int64_t end_ns)
+{
+    game_init(seed);
+    for (size_t i = 0; i < n && !game_over; i++)
+        game_key(ev[i].t_ns, ev[i].key);
+    game_advance(end_ns);
+}
+
+static int get_le(FILE *f, uint64_t *v, int bytes)
+{
+    *v = 0;
+    for (int i = 0; i < bytes; i++) {
+        int c = fgetc(f);
+        if (c == EOF) return -1;
+        *v |= (uint64_t)c << (8 * i);
+    }
+    return 0;
+}
+
+static int get_varint(FILE *f, uint64_t *v)
+{
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(f);
+        if (c == EOF) return -1;
+        *v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return 0;
+    }
+    return -1;
+}
+
+/* replay a file headless and check the end state against the recording.
+ * Returns 0 when it matches, 1 when not, 2 when the file is bad. */
+int replay_check(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 2;
+    }
+    char magic[4];
+    uint64_t version, seed, delta, want_hash;
+    Event *ev = NULL;
+    size_t n = 0, cap = 0;
+    int64_t t_ns = 0;
+    int key, want_over = -1;
+
+    if (fread(magic, 1, 4, f) != 4 || memcmp(magic, REPLAY_MAGIC, 4) != 0 ||
+        get_le(f, &version, 4) < 0 || version != REPLAY_VERSION ||
+        get_le(f, &seed, 8) < 0)
+        goto bad;
+    for (;;) {
+        if (get_varint(f, &delta) < 0 || (key = fgetc(f)) == EOF) goto bad;
+        t_ns += (int64_t)delta * 1000;
+        if (key == 0) break;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            ev = (Event *)realloc(ev, cap * sizeof(Event));
+        }
+        ev[n].t_ns = t_ns;
+        ev[n].key = key;
+        n++;
+    }
+    if ((want_over = fgetc(f)) == EOF || get_le(f, &want_hash, 8) < 0)
+        goto bad;
+    fclose(f);
+
+    headless = 1;
+    game_replay(seed, ev, n, t_ns);
+    free(ev);
+    printf("%s: seed %llu, %zu keys, %.3f s, game_over %d, hash %016llx: %s\n",
+           path, (unsigned long long)seed, n, t_ns / 1e9, game_over,
+           (unsigned long long)game_hash(),
+           game_over == want_over && game_hash() == want_hash ?
+           "ok" : "MISMATCH");
+    return game_over == want_over && game_hash() == want_hash ? 0 : 1;
+
+bad:
+    fprintf(stderr, "%s: not a replay file or truncated\n", path);
+    fclose(f);
+    free(ev);
+    return 2;
+}
+
+/* play games headless with a random player (keys 30-300 ms apart), replay
+ * each from its recorded keys and check it ends in the same state, and
+ * report the rate */
+int bench(uint64_t seed, long games)
+{
+    unsigned long outcomes[4] = {0, 0, 0, 0};
+    unsigned long keys = 0, mismatches = 0;
+    Event *copy = NULL;
+    size_t copy_cap = 0;
+    struct timespec t0, t1;
+
+    headless = 1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long g = 0; g < games; g++) {
+        uint64_t player = (seed + g) * 0x9E3779B97F4A7C15ULL | 1;
+        int64_t t = 0;
+        game_init(seed + g);
+        while (!game_over && t < BENCH_LIMIT_NS) {
+            t += (30 + rng_next(&player) % 271) * 1000000LL;
+            game_key(t, "wasd"[rng_next(&player) % 4]);
+        }
+        if (!game_over) game_key(t, 'q');
+        outcomes[game_over & 3]++;
+        keys += rec_len;
+
+        int over = game_over;
+        uint64_t hash = game_hash();
+        int64_t end_ns = sim_ns;
+        size_t n = rec_len;
+        if (n > copy_cap) {
+            copy_cap = rec_cap;
+            copy = (Event *)realloc(copy, copy_cap * sizeof(Event));
+        }
+        memcpy(copy, rec_events, n * sizeof(Event));
+        game_replay(seed + g, copy, n, end_ns);
+        if (game_over != over || game_hash() != hash) mismatches++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    free(copy);
+
+    double secs = (ts_ns(&t1) - ts_ns(&t0)) / 1e9;
+    printf("%ld games (seeds %llu..%llu) in %.3f s: %.0f games/s with replay, "
+           "%lu keys\n", games, (unsigned long long)seed,
+           (unsigned long long)(seed + games - 1), secs, games / secs, keys);
+    printf("lose %lu, win %lu, quit %lu, replay mismatches %lu\n",
+           outcomes[1], outcomes[2], outcomes[3], mismatches);
+    return mismatches ? 1 : 0;
+}
+
+void end_screen(int reason)
+{
+    printf("\033[H\033[2J");
+    if (reason == 1) {
+        printf("You loss the game!!\n");
+    } else if (reason == 2) {
+        printf("You win the game!!\n");
+    } else if (reason == 3) {
+        printf("You exit the game.\n");
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *record_path = NULL, *replay_path = NULL;
+    uint64_t seed = 0;
+    long bench_games = 0;
+    int show_ticks = 0, seeded = 0, opt;
+
+    while ((opt = getopt(argc, argv, "ts:w:r:b:")) != -1) {
+        switch (opt) {
+        case 't': show_ticks = 1; break;
+        case 's': seed = strtoull(optarg, NULL, 0); seeded = 1; break;
+        case 'w': record_path = optarg; break;
+        case 'r': replay_path = optarg; break;
+        case 'b': bench_games = atol(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-t] [-s seed] [-w replay]\n"
+                    "       %s -r replay\n"
+                    "       %s -b games [-s seed]\n", argv[0], argv[0], argv[0]);
+            return 2;
+        }
+    }
+    if (replay_path) return replay_check(replay_path);
+    if (bench_games > 0) return bench(seeded ? seed : 1, bench_games);
+    if (!seeded) seed = ((uint64_t)time(NULL) << 16) ^ (uint64_t)getpid();
+
+    game_init(seed);
+    map_publish();
+
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+    term_setup();
+    game_start_ns = game_clock();
 
     // create threads
-    pthread_t input_thread, mover_thread;
+    pthread_t input_thread, mover_thread, render_thread;
+    pthread_create(&render_thread, NULL, render_thread_fn, NULL);
     pthread_create(&input_thread, NULL, input_thread_fn, NULL);
     pthread_create(&mover_thread, NULL, move_thread_fn, NULL);
 
     // wait for threads
     pthread_join(input_thread, NULL);
     pthread_join(mover_thread, NULL);
+    render_stop = 1;
+    pthread_join(render_thread, NULL);
 
     // show end screen based on game_over
     if (game_over == 1) end_screen(1);
     else if (game_over == 2) end_screen(2);
     else if (game_over == 3) end_screen(3);
     else end_screen(3);
+    if (show_ticks) tick_report();
+    if (record_path && replay_write(record_path, seed) < 0) {
+        perror(record_path);
+        return 1;
+    }
 
     return 0;
-}
\ No newline at end of file
+}